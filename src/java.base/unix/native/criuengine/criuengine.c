@@ -36,8 +36,34 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <signal.h>
+#include <stdarg.h>
+#include <time.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <dlfcn.h>
+#include <sched.h>
+#include <sys/file.h>
+#include <sys/random.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mount.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <pthread.h>
+#include <linux/userfaultfd.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#endif
 
 #define RESTORE_SIGNAL   (SIGRTMIN + 2)
 
@@ -47,6 +73,75 @@
 
 #define SUPPRESS_ERROR_IN_PARENT 77
 
+// Path of the append-only file receiving one record per engine operation
+#define METRICS_ENV "CRAC_ENGINE_METRICS"
+// Passed through CRIU to the post-resume action script
+#define RESTORE_START_ENV "CRAC_RESTORE_START_NS"
+#define RESTORE_IMAGEDIR_ENV "CRAC_RESTORE_IMAGEDIR"
+
+// Checkpoint writes per-block checksums of the images if set
+#define CHECKSUMS_ENV "CRAC_IMAGE_CHECKSUMS"
+// Restore skips verification of the checksums if set to "false"
+#define VERIFY_ENV "CRAC_IMAGE_VERIFY"
+// Passed through CRIU to the post-resume action script
+#define VERIFY_STATUS_ENV "CRAC_VERIFY_STATUS"
+#define CHECKSUMS_NAME "crac-checksums"
+#define CHECKSUM_BLOCK (1 << 20)
+
+// File with a raw AES-256 key to encrypt images on checkpoint and decrypt on restore
+#define KEY_FILE_ENV "CRAC_IMAGE_KEY_FILE"
+// Where restore puts decrypted images, memory-backed by default. Lazy pages
+// the injector decrypts straight into the processes are left out.
+#define DECRYPT_DIR_ENV "CRAC_IMAGE_DECRYPT_DIR"
+// Passed through CRIU to the post-resume action script
+#define DECRYPTED_ENV "CRAC_DECRYPTED_IMAGEDIR"
+#define DECRYPT_TIME_ENV "CRAC_DECRYPT_NS"
+#define ENCRYPTED_NAME "crac-encrypted"
+#define ENCRYPT_BLOCK (1 << 20)
+#define ENCRYPT_MAGIC "CRACENC2"
+#define GCM_TAG_SIZE 16
+
+// Restore into a new time namespace: "auto" continues the clocks from the
+// checkpoint, a number shifts CLOCK_MONOTONIC and CLOCK_BOOTTIME by seconds
+#define TIMENS_ENV "CRAC_RESTORE_TIMENS"
+// Passed through CRIU to the post-resume action script
+#define TIMENS_USED_ENV "CRAC_TIMENS_USED"
+// Length of the window after restore to measure the JVM's activity in
+#define TIMER_BURST_ENV "CRAC_RESTORE_TIMER_BURST_MS"
+#define CLOCKS_NAME "crac-clocks"
+
+// Checkpoint into a per-resource-class variant subdirectory of the image dir
+#define VARIANTS_ENV "CRAC_IMAGE_VARIANTS"
+#define VARIANT_FORMAT "mem%lldm-cpu%d"
+
+// Restore lazy pages by userfaultfd with this many engine threads
+#define UFFD_THREADS_ENV "CRAC_RESTORE_UFFD_THREADS"
+// Passed through CRIU to the post-resume action script
+#define UFFD_STATUS_ENV "CRAC_UFFD_STATUS"
+// Where CRIU restoring with --lazy-pages connects to, in its working directory
+#define LAZY_PAGES_SOCKET "lazy-pages.socket"
+
+// Restore into a new pid namespace: "always", or "auto" when a pid of the
+// image is taken
+#define PIDNS_ENV "CRAC_RESTORE_PIDNS"
+// Passed through CRIU to the post-resume action script
+#define PIDNS_USED_ENV "CRAC_PIDNS_USED"
+// Passed through CRIU to restorewait, the init of the namespace: the file
+// it writes the signal the JVM died of to, for the proxy outside to die of
+#define PIDNS_SIGNAL_ENV "CRAC_PIDNS_SIGNAL"
+#define PSTREE_MAGIC 0x50273030
+
+// Image statistics CRIU leaves in the image directory
+#define STATS_DUMP_NAME "stats-dump"
+#define IMG_SERVICE_MAGIC 0x55105940
+#define STATS_MAGIC 0x57093306
+
+#define MSGPREFIX ""
+
+#ifndef CLONE_NEWTIME
+#define CLONE_NEWTIME 0x00000080
+#endif
+
 static int g_pid;
 
 static char *verbosity = NULL; // default differs for checkpoint and restore
@@ -80,42 +175,3280 @@ static void print_args_to_stderr(const char **args) {
                 fputs("'\\''", stderr);
             }
         }
-        fputc('\'', stderr);
+        fputc('\'', stderr);
+    }
+}
+
+static void print_command_args_to_stderr(const char **args) {
+  fprintf(stderr, "Command: ");
+  print_args_to_stderr(args);
+  fputc('\n', stderr);
+}
+
+static const char *join_path(const char *path1, const char *path2) {
+    char *retval;
+    if (asprintf(&retval, "%s/%s", path1, path2) == -1) {
+        perror("asprintf");
+        exit(1);
+    }
+    return retval;
+}
+
+static const char *path_abs(const char *rel) {
+    if (rel[0] == '/') {
+        return rel;
+    }
+    char *cwd = get_current_dir_name();
+    if (!cwd) {
+        perror("get_current_dir_name");
+        exit(1);
+    }
+    return join_path(cwd, rel);
+}
+
+static const char *path_abs2(const char *rel1, const char *rel2) {
+    if (rel2[0] == '/') {
+        return rel2;
+    }
+    return join_path(path_abs(rel1), rel2);
+}
+
+static long long realtime_ns(void) {
+    // CLOCK_REALTIME is the only clock comparable between the engine and the
+    // action script regardless of the namespaces CRIU puts the latter into
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long long dir_size(const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return -1;
+    }
+    long long size = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir))) {
+        struct stat st;
+        if (!fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) && S_ISREG(st.st_mode)) {
+            size += st.st_size;
+        }
+    }
+    closedir(dir);
+    return size;
+}
+
+// Identifies an image directory in the metrics records, by device and inode
+// as its path may be spelt differently or contain spaces
+static bool image_id(const char *dir, char *buf, size_t len) {
+    struct stat st;
+    if (stat(dir, &st)) {
+        return false;
+    }
+    snprintf(buf, len, "%llx:%llx", (unsigned long long)st.st_dev, (unsigned long long)st.st_ino);
+    return true;
+}
+
+// Appends a "key=value ..." record to the metrics sink, if one is configured.
+// Records are written with a single O_APPEND write so that concurrent engines
+// sharing a sink never interleave.
+static void metrics_record(const char *fmt, ...) {
+    const char *path = getenv(METRICS_ENV);
+    if (!path) {
+        return;
+    }
+    char buf[1024];
+    int len = snprintf(buf, sizeof(buf), "ts=%lld ", realtime_ns());
+    va_list ap;
+    va_start(ap, fmt);
+    len += vsnprintf(buf + len, sizeof(buf) - len, fmt, ap);
+    va_end(ap);
+    if ((size_t)len >= sizeof(buf) - 1) {
+        len = sizeof(buf) - 2;
+    }
+    buf[len++] = '\n';
+
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open metrics file %s: %s\n", path, strerror(errno));
+        return;
+    }
+    if (write(fd, buf, len) != len) {
+        fprintf(stderr, "Cannot write metrics file %s: %s\n", path, strerror(errno));
+    }
+    close(fd);
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *buf, size_t len) {
+    static uint32_t table[256];
+    if (!table[1]) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = c & 1 ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+            }
+            table[i] = c;
+        }
+    }
+    while (len--) {
+        crc = table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *buf, size_t len) {
+    uint64_t c = crc;
+    for (; len >= 8; len -= 8, buf += 8) {
+        uint64_t v;
+        memcpy(&v, buf, sizeof(v));
+        c = _mm_crc32_u64(c, v);
+    }
+    crc = (uint32_t)c;
+    for (; len; --len) {
+        crc = _mm_crc32_u8(crc, *buf++);
+    }
+    return crc;
+}
+
+static bool crc32c_hw_supported(void) {
+    return __builtin_cpu_supports("sse4.2");
+}
+#elif defined(__aarch64__)
+__attribute__((target("+crc")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *buf, size_t len) {
+    for (; len >= 8; len -= 8, buf += 8) {
+        uint64_t v;
+        memcpy(&v, buf, sizeof(v));
+        crc = __crc32cd(crc, v);
+    }
+    for (; len; --len) {
+        crc = __crc32cb(crc, *buf++);
+    }
+    return crc;
+}
+
+static bool crc32c_hw_supported(void) {
+    return getauxval(AT_HWCAP) & HWCAP_CRC32;
+}
+#else
+#define crc32c_hw crc32c_sw
+
+static bool crc32c_hw_supported(void) {
+    return false;
+}
+#endif
+
+static uint32_t crc32c(const void *buf, size_t len) {
+    static int hw = -1;
+    if (hw < 0) {
+        hw = crc32c_hw_supported();
+    }
+    uint32_t crc = ~0U;
+    crc = hw ? crc32c_hw(crc, buf, len) : crc32c_sw(crc, buf, len);
+    return ~crc;
+}
+
+static int is_image_file(const struct dirent *ent) {
+    size_t len = strlen(ent->d_name);
+    return len > 4 && !strcmp(ent->d_name + len - 4, ".img");
+}
+
+// Writes CHECKSUMS_NAME to imagedir: a line per image file with its size and
+// CRC32C of each CHECKSUM_BLOCK of the file
+static int write_checksums(const char *imagedir) {
+    struct dirent **ents;
+    int n = scandir(imagedir, &ents, is_image_file, alphasort);
+    if (n < 0) {
+        fprintf(stderr, "Cannot list %s: %s\n", imagedir, strerror(errno));
+        return 1;
+    }
+
+    const char *path = join_path(imagedir, CHECKSUMS_NAME);
+    FILE *out = fopen(path, "w");
+    unsigned char *buf = malloc(CHECKSUM_BLOCK);
+    int ret = 0;
+    if (!out || !buf) {
+        fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+        ret = 1;
+    }
+    if (out) {
+        fprintf(out, "# crc32c %d\n", CHECKSUM_BLOCK);
+    }
+
+    for (int i = 0; i < n; ++i) {
+        if (!ret) {
+            int fd = open(join_path(imagedir, ents[i]->d_name), O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st)) {
+                fprintf(stderr, "Cannot open %s: %s\n", ents[i]->d_name, strerror(errno));
+                ret = 1;
+            } else {
+                posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+                fprintf(out, "%s %lld", ents[i]->d_name, (long long)st.st_size);
+                ssize_t r;
+                while (0 < (r = read(fd, buf, CHECKSUM_BLOCK))) {
+                    fprintf(out, " %08x", crc32c(buf, r));
+                }
+                fputc('\n', out);
+                if (r < 0) {
+                    fprintf(stderr, "Cannot read %s: %s\n", ents[i]->d_name, strerror(errno));
+                    ret = 1;
+                }
+            }
+            if (0 <= fd) {
+                close(fd);
+            }
+        }
+        free(ents[i]);
+    }
+    free(ents);
+    free(buf);
+
+    if (out && fclose(out)) {
+        fprintf(stderr, "Cannot write %s: %s\n", path, strerror(errno));
+        ret = 1;
+    }
+    if (ret) {
+        unlink(path);
+    }
+    return ret;
+}
+
+// Checks imagedir against its CHECKSUMS_NAME. Returns 0 on match, 1 on
+// mismatch or error, -1 if there are no checksums to verify.
+static int verify_checksums(const char *imagedir, long long *verified) {
+    const char *path = join_path(imagedir, CHECKSUMS_NAME);
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        return errno == ENOENT ? -1 : 1;
+    }
+
+    unsigned char *buf = malloc(CHECKSUM_BLOCK);
+    char *line = NULL;
+    size_t linecap = 0;
+    int block = 0;
+    int ret = 0;
+    char **listed = NULL;
+    size_t nlisted = 0;
+    *verified = 0;
+    if (!buf || getline(&line, &linecap, in) < 0 || sscanf(line, "# crc32c %d", &block) != 1
+            || block != CHECKSUM_BLOCK) {
+        fprintf(stderr, "Malformed %s\n", path);
+        ret = 1;
+    }
+
+    while (!ret && getline(&line, &linecap, in) > 0) {
+        char *save;
+        const char *name = strtok_r(line, " \n", &save);
+        const char *sizestr = strtok_r(NULL, " \n", &save);
+        if (!name || !sizestr || strchr(name, '/')) {
+            fprintf(stderr, "Malformed %s\n", path);
+            ret = 1;
+            break;
+        }
+        char **grown = realloc(listed, (nlisted + 1) * sizeof(*listed));
+        if (!grown || !(grown[nlisted] = strdup(name))) {
+            perror("realloc");
+            exit(1);
+        }
+        listed = grown;
+        ++nlisted;
+
+        int fd = open(join_path(imagedir, name), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st)) {
+            fprintf(stderr, "Cannot open %s: %s\n", name, strerror(errno));
+            ret = 1;
+        } else if (st.st_size != atoll(sizestr)) {
+            fprintf(stderr, "Image %s has size %lld, expected %s\n", name, (long long)st.st_size, sizestr);
+            ret = 1;
+        } else {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            long long blocks = (st.st_size + CHECKSUM_BLOCK - 1) / CHECKSUM_BLOCK;
+            long long nsums = 0;
+            long long off = 0;
+            const char *expected;
+            while ((expected = strtok_r(NULL, " \n", &save))) {
+                ssize_t r = ++nsums <= blocks ? read(fd, buf, CHECKSUM_BLOCK) : 0;
+                if (r <= 0) {
+                    continue;
+                }
+                if (crc32c(buf, r) != strtoul(expected, NULL, 16)) {
+                    fprintf(stderr, "Image %s is corrupted at offset %lld\n", name, off);
+                    ret = 1;
+                    break;
+                }
+                off += r;
+            }
+            // Every block has to be checked, a short line leaves the tail unchecked
+            if (!ret && (nsums != blocks || off != st.st_size)) {
+                fprintf(stderr, "Image %s has %lld checksums, expected %lld\n", name, nsums, blocks);
+                ret = 1;
+            }
+            *verified += off;
+        }
+        if (0 <= fd) {
+            close(fd);
+        }
+    }
+
+    // An image that is not listed is not verified, and must not be restored
+    struct dirent **ents;
+    int n = ret ? 0 : scandir(imagedir, &ents, is_image_file, alphasort);
+    if (n < 0) {
+        fprintf(stderr, "Cannot list %s: %s\n", imagedir, strerror(errno));
+        ret = 1;
+    }
+    for (int i = 0; i < n; ++i) {
+        size_t j = 0;
+        while (j < nlisted && strcmp(listed[j], ents[i]->d_name)) {
+            ++j;
+        }
+        if (!ret && j == nlisted) {
+            fprintf(stderr, "Image %s has no checksums in %s\n", ents[i]->d_name, path);
+            ret = 1;
+        }
+        free(ents[i]);
+    }
+    if (0 < n) {
+        free(ents);
+    }
+
+    for (size_t j = 0; j < nlisted; ++j) {
+        free(listed[j]);
+    }
+    free(listed);
+    free(line);
+    free(buf);
+    fclose(in);
+    return ret;
+}
+
+static int verify(const char *imagedir) {
+    if (!imagedir) {
+        fprintf(stderr, "image directory is not specified\n");
+        return 1;
+    }
+    long long start = realtime_ns();
+    long long verified;
+    int ret = verify_checksums(imagedir, &verified);
+    if (ret < 0) {
+        fprintf(stderr, "No %s in %s\n", CHECKSUMS_NAME, imagedir);
+        return 1;
+    }
+    double secs = (realtime_ns() - start) / 1e9;
+    fprintf(stderr, "%s: verified %lld bytes in %.3f s (%.0f MB/s, %s CRC32C)\n",
+            ret ? "FAILED" : "OK", verified, secs, verified / 1e6 / (secs > 0 ? secs : 1e-9),
+            crc32c_hw_supported() ? "hardware" : "software");
+    return ret;
+}
+
+// Waits until path is removed, or CRIU (which becomes restorewait on
+// success) is gone
+static void await_criu(pid_t criu, const char *path) {
+    struct stat st;
+    while (!kill(criu, 0) && !stat(path, &st)) {
+        usleep(100000);
+    }
+}
+
+// Verifies images in a detached process, concurrently with CRIU reading
+// them. The result is left in a file locked until verification completes,
+// for post-resume to collect before the JVM is kicked.
+static void start_verification(const char *imagedir) {
+    const char *verifyenv = getenv(VERIFY_ENV);
+    struct stat st;
+    if ((verifyenv && !strcmp(verifyenv, "false")) || stat(join_path(imagedir, CHECKSUMS_NAME), &st)) {
+        return;
+    }
+
+    char *status = NULL;
+    const char *tmpdir = getenv("TMPDIR");
+    if (asprintf(&status, "%s/crac-verify-XXXXXX", tmpdir ? tmpdir : "/tmp") < 0) {
+        return;
+    }
+    int fd = mkostemp(status, O_CLOEXEC);
+    if (fd < 0 || flock(fd, LOCK_EX)) {
+        fprintf(stderr, "Cannot create verification status %s: %s\n", status, strerror(errno));
+        if (0 <= fd) {
+            close(fd);
+            unlink(status);
+        }
+        free(status);
+        return;
+    }
+
+    pid_t criu = getpid();
+    pid_t child = fork();
+    if (!child) {
+        // Don't leave a child for CRIU to find
+        if (fork()) {
+            exit(0);
+        }
+        long long verified;
+        long long start = realtime_ns();
+        int ret = verify_checksums(imagedir, &verified);
+        dprintf(fd, "%s %lld %lld\n", ret ? "fail" : "ok", verified, realtime_ns() - start);
+        close(fd);
+        // post-resume removes the status, unless CRIU fails before it runs
+        await_criu(criu, status);
+        unlink(status);
+        exit(0);
+    }
+    if (child < 0) {
+        perror("fork");
+        unlink(status);
+    } else {
+        waitpid(child, NULL, 0);
+        setenv(VERIFY_STATUS_ENV, status, 1);
+    }
+    close(fd);
+}
+
+// Returns false if images failed verification
+static bool finish_verification(long long *wait_ns) {
+    *wait_ns = 0;
+    const char *status = getenv(VERIFY_STATUS_ENV);
+    if (!status) {
+        return true;
+    }
+    int fd = open(status, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open verification status %s: %s\n", status, strerror(errno));
+        return false;
+    }
+    long long start = realtime_ns();
+    while (flock(fd, LOCK_SH) && errno == EINTR);
+    *wait_ns = realtime_ns() - start;
+
+    char buf[64] = "";
+    if (read(fd, buf, sizeof(buf) - 1) < 0) {
+        buf[0] = '\0';
+    }
+    close(fd);
+    unlink(status);
+    return !strncmp(buf, "ok ", 3);
+}
+
+static bool read_full(int fd, void *buf, size_t len) {
+    while (len) {
+        ssize_t r = read(fd, buf, len);
+        if (r <= 0) {
+            if (r < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf = (char *)buf + r;
+        len -= r;
+    }
+    return true;
+}
+
+static bool write_full(int fd, const void *buf, size_t len) {
+    while (len) {
+        ssize_t r = write(fd, buf, len);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf = (const char *)buf + r;
+        len -= r;
+    }
+    return true;
+}
+
+// AES-GCM from the system libcrypto, which picks AES-NI/VAES (or the ARMv8
+// crypto extensions) by itself. It is loaded on demand so that the engine
+// does not depend on it unless images are encrypted.
+#define EVP_CTRL_GCM_GET_TAG 0x10
+#define EVP_CTRL_GCM_SET_TAG 0x11
+
+static struct {
+    void *(*ctx_new)(void);
+    void (*ctx_free)(void *ctx);
+    const void *(*aes_256_gcm)(void);
+    int (*ctx_ctrl)(void *ctx, int type, int arg, void *ptr);
+    int (*encrypt_init)(void *ctx, const void *cipher, void *impl, const unsigned char *key, const unsigned char *iv);
+    int (*encrypt_update)(void *ctx, unsigned char *out, int *outl, const unsigned char *in, int inl);
+    int (*encrypt_final)(void *ctx, unsigned char *out, int *outl);
+    int (*decrypt_init)(void *ctx, const void *cipher, void *impl, const unsigned char *key, const unsigned char *iv);
+    int (*decrypt_update)(void *ctx, unsigned char *out, int *outl, const unsigned char *in, int inl);
+    int (*decrypt_final)(void *ctx, unsigned char *out, int *outl);
+} evp;
+
+static bool load_crypto(void) {
+    static const char *libs[] = { "libcrypto.so.3", "libcrypto.so.1.1", "libcrypto.so" };
+    if (evp.ctx_new) {
+        return true;
+    }
+    void *lib = NULL;
+    for (size_t i = 0; !lib && i < ARRAY_SIZE(libs); ++i) {
+        lib = dlopen(libs[i], RTLD_NOW | RTLD_LOCAL);
+    }
+    if (!lib) {
+        fprintf(stderr, "Cannot load libcrypto: %s\n", dlerror());
+        return false;
+    }
+    struct { void **fn; const char *name; } syms[] = {
+        { (void **)&evp.ctx_new, "EVP_CIPHER_CTX_new" },
+        { (void **)&evp.ctx_free, "EVP_CIPHER_CTX_free" },
+        { (void **)&evp.aes_256_gcm, "EVP_aes_256_gcm" },
+        { (void **)&evp.ctx_ctrl, "EVP_CIPHER_CTX_ctrl" },
+        { (void **)&evp.encrypt_init, "EVP_EncryptInit_ex" },
+        { (void **)&evp.encrypt_update, "EVP_EncryptUpdate" },
+        { (void **)&evp.encrypt_final, "EVP_EncryptFinal_ex" },
+        { (void **)&evp.decrypt_init, "EVP_DecryptInit_ex" },
+        { (void **)&evp.decrypt_update, "EVP_DecryptUpdate" },
+        { (void **)&evp.decrypt_final, "EVP_DecryptFinal_ex" },
+    };
+    for (size_t i = 0; i < ARRAY_SIZE(syms); ++i) {
+        if (!(*syms[i].fn = dlsym(lib, syms[i].name))) {
+            fprintf(stderr, "Cannot find %s in libcrypto\n", syms[i].name);
+            evp.ctx_new = NULL;
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool read_key(unsigned char key[32]) {
+    const char *path = getenv(KEY_FILE_ENV);
+    int fd = path ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) || st.st_size != 32 || !read_full(fd, key, 32)) {
+        fprintf(stderr, "Cannot read 32-byte key from %s=%s\n", KEY_FILE_ENV, path ? path : "");
+        if (0 <= fd) {
+            close(fd);
+        }
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+// Encrypted image file layout: the header, then every ENCRYPT_BLOCK of the
+// plain file as ciphertext followed by its GCM tag; an empty file has one
+// empty block. Each block has its own IV (the per-file salt and the block
+// index) and is authenticated together with the file name, the block index
+// and the header, so blocks can be neither swapped nor dropped, and the
+// size can't be changed.
+struct enc_header {
+    char magic[8];
+    uint64_t size;
+    uint32_t block;
+    uint32_t reserved;
+    unsigned char salt[8];
+};
+
+static uint64_t enc_blocks(uint64_t size) {
+    return size ? (size + ENCRYPT_BLOCK - 1) / ENCRYPT_BLOCK : 1;
+}
+
+static off_t enc_block_offset(uint64_t index) {
+    return sizeof(struct enc_header) + index * (ENCRYPT_BLOCK + GCM_TAG_SIZE);
+}
+
+static int enc_block_len(const struct enc_header *hdr, uint64_t index) {
+    uint64_t left = hdr->size - index * ENCRYPT_BLOCK;
+    return left < ENCRYPT_BLOCK ? (int)left : ENCRYPT_BLOCK;
+}
+
+static void block_iv(const struct enc_header *hdr, uint32_t index, unsigned char iv[12]) {
+    memcpy(iv, hdr->salt, sizeof(hdr->salt));
+    iv[8] = index >> 24;
+    iv[9] = index >> 16;
+    iv[10] = index >> 8;
+    iv[11] = index;
+}
+
+static bool block_aad(void *ctx, bool enc, const struct enc_header *hdr, const char *name, uint32_t index) {
+    int (*update)(void *, unsigned char *, int *, const unsigned char *, int) = enc ? evp.encrypt_update : evp.decrypt_update;
+    int len;
+    return update(ctx, NULL, &len, (const unsigned char *)name, strlen(name) + 1)
+        && update(ctx, NULL, &len, (const unsigned char *)&index, sizeof(index))
+        && update(ctx, NULL, &len, (const unsigned char *)hdr, sizeof(*hdr));
+}
+
+// A cipher context set up with the key, NULL on failure
+static void *crypt_ctx(bool enc, const unsigned char *key) {
+    void *ctx = evp.ctx_new();
+    if (ctx && !(enc ? evp.encrypt_init : evp.decrypt_init)(ctx, evp.aes_256_gcm(), NULL, key, NULL)) {
+        evp.ctx_free(ctx);
+        ctx = NULL;
+    }
+    if (!ctx) {
+        fprintf(stderr, "Cannot initialize AES-GCM\n");
+    }
+    return ctx;
+}
+
+// Encrypts len bytes of block index into out, followed by the tag, or
+// decrypts them from in, followed by the tag, checking it
+static bool crypt_block(void *ctx, bool enc, const struct enc_header *hdr, const char *name, uint32_t index,
+        const unsigned char *in, int len, unsigned char *out) {
+    unsigned char iv[12];
+    int outlen;
+    block_iv(hdr, index, iv);
+    if (enc) {
+        return evp.encrypt_init(ctx, NULL, NULL, NULL, iv) && block_aad(ctx, true, hdr, name, index)
+            && evp.encrypt_update(ctx, out, &outlen, in, len)
+            && evp.encrypt_final(ctx, out + outlen, &outlen)
+            && evp.ctx_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, GCM_TAG_SIZE, out + len);
+    }
+    return evp.decrypt_init(ctx, NULL, NULL, NULL, iv) && block_aad(ctx, false, hdr, name, index)
+        && evp.decrypt_update(ctx, out, &outlen, in, len)
+        && evp.ctx_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, GCM_TAG_SIZE, (void *)(in + len))
+        && evp.decrypt_final(ctx, out + outlen, &outlen);
+}
+
+// Reads the header of an encrypted image and checks that the file holds
+// exactly the blocks it announces
+static bool read_enc_header(int fd, const char *path, struct enc_header *hdr) {
+    struct stat st;
+    if (!read_full(fd, hdr, sizeof(*hdr)) || memcmp(hdr->magic, ENCRYPT_MAGIC, sizeof(hdr->magic))
+            || hdr->block != ENCRYPT_BLOCK || fstat(fd, &st)) {
+        fprintf(stderr, "Image %s is not encrypted by the engine\n", path);
+        return false;
+    }
+    uint64_t expected = enc_block_offset(enc_blocks(hdr->size) - 1) + enc_block_len(hdr, enc_blocks(hdr->size) - 1)
+        + GCM_TAG_SIZE;
+    if ((uint64_t)st.st_size != expected) {
+        fprintf(stderr, "Image %s has size %lld, expected %" PRIu64 "\n", path, (long long)st.st_size, expected);
+        return false;
+    }
+    return true;
+}
+
+// Plain byte range of an image file
+struct byte_range {
+    uint64_t start;
+    uint64_t end;
+};
+
+// True if [start, end) is within ranges, which are sorted and coalesced
+static bool ranges_cover(const struct byte_range *ranges, size_t n, uint64_t start, uint64_t end) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (ranges[mid].end <= start) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < n && ranges[lo].start <= start && end <= ranges[lo].end;
+}
+
+// Encrypts (or decrypts) file name from indir into outdir, one block at a
+// time. Decryption leaves out the blocks entirely within skip, as holes.
+static int crypt_file(bool enc, const unsigned char *key, const char *indir, const char *outdir, const char *name,
+        const struct byte_range *skip, size_t nskip) {
+    const char *inpath = join_path(indir, name);
+    const char *outpath = enc ? join_path(outdir, ENCRYPTED_NAME ".tmp") : join_path(outdir, name);
+    int in = open(inpath, O_RDONLY | O_CLOEXEC);
+    int out = open(outpath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    unsigned char *plain = malloc(ENCRYPT_BLOCK);
+    unsigned char *cipher = malloc(ENCRYPT_BLOCK + GCM_TAG_SIZE);
+    void *ctx = NULL;
+    struct stat st;
+    int ret = 1;
+    if (in < 0 || out < 0 || fstat(in, &st) || !plain || !cipher) {
+        fprintf(stderr, "Cannot %scrypt %s: %s\n", enc ? "en" : "de", inpath, strerror(errno));
+        goto out;
+    }
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    struct enc_header hdr;
+    if (enc) {
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, ENCRYPT_MAGIC, sizeof(hdr.magic));
+        hdr.size = st.st_size;
+        hdr.block = ENCRYPT_BLOCK;
+        if (getrandom(hdr.salt, sizeof(hdr.salt), 0) != sizeof(hdr.salt) || !write_full(out, &hdr, sizeof(hdr))) {
+            fprintf(stderr, "Cannot write %s: %s\n", outpath, strerror(errno));
+            goto out;
+        }
+    } else if (!read_enc_header(in, inpath, &hdr)) {
+        goto out;
+    }
+    if (!(ctx = crypt_ctx(enc, key))) {
+        goto out;
+    }
+
+    for (uint64_t index = 0; index < enc_blocks(hdr.size); ++index) {
+        int len = enc_block_len(&hdr, index);
+        if (enc) {
+            if (!read_full(in, plain, len)) {
+                fprintf(stderr, "Cannot read %s: %s\n", inpath, strerror(errno));
+                goto out;
+            }
+            if (!crypt_block(ctx, true, &hdr, name, index, plain, len, cipher)) {
+                fprintf(stderr, "Cannot encrypt %s\n", inpath);
+                goto out;
+            }
+            if (!write_full(out, cipher, len + GCM_TAG_SIZE)) {
+                fprintf(stderr, "Cannot write %s: %s\n", outpath, strerror(errno));
+                goto out;
+            }
+        } else if (ranges_cover(skip, nskip, index * ENCRYPT_BLOCK, index * ENCRYPT_BLOCK + len)) {
+            if (lseek(in, len + GCM_TAG_SIZE, SEEK_CUR) < 0 || lseek(out, len, SEEK_CUR) < 0) {
+                fprintf(stderr, "Cannot skip in %s: %s\n", inpath, strerror(errno));
+                goto out;
+            }
+        } else {
+            if (!read_full(in, cipher, len + GCM_TAG_SIZE)) {
+                fprintf(stderr, "Image %s is truncated\n", inpath);
+                goto out;
+            }
+            if (!crypt_block(ctx, false, &hdr, name, index, cipher, len, plain)) {
+                fprintf(stderr, "Image %s failed authentication (wrong key or corrupted)\n", inpath);
+                goto out;
+            }
+            if (!write_full(out, plain, len)) {
+                fprintf(stderr, "Cannot write %s: %s\n", outpath, strerror(errno));
+                goto out;
+            }
+        }
+    }
+
+    if (enc && rename(outpath, inpath)) {
+        fprintf(stderr, "Cannot replace %s: %s\n", inpath, strerror(errno));
+        goto out;
+    }
+    if (!enc && ftruncate(out, hdr.size)) {
+        fprintf(stderr, "Cannot write %s: %s\n", outpath, strerror(errno));
+        goto out;
+    }
+    ret = 0;
+out:
+    if (ctx) {
+        evp.ctx_free(ctx);
+    }
+    free(plain);
+    free(cipher);
+    if (0 <= in) {
+        close(in);
+    }
+    if (0 <= out) {
+        close(out);
+        if (ret) {
+            unlink(outpath);
+        }
+    }
+    return ret;
+}
+
+// pages-<id>.img, kept by the injector from the decrypted images when it
+// decrypts lazy pages itself
+static int is_pages_image(const struct dirent *ent) {
+    unsigned long long id;
+    int len = 0;
+    return sscanf(ent->d_name, "pages-%llu.img%n", &id, &len) == 1 && len && !ent->d_name[len];
+}
+
+static int is_metadata_image(const struct dirent *ent) {
+    return is_image_file(ent) && !is_pages_image(ent);
+}
+
+// Encrypts or decrypts the images in indir selected by filter, writing
+// them to outdir
+static int crypt_images(bool enc, const char *indir, const char *outdir, int (*filter)(const struct dirent *),
+        long long *bytes) {
+    unsigned char key[32];
+    if (!load_crypto() || !read_key(key)) {
+        return 1;
+    }
+    struct dirent **ents;
+    int n = scandir(indir, &ents, filter, alphasort);
+    if (n < 0) {
+        fprintf(stderr, "Cannot list %s: %s\n", indir, strerror(errno));
+        return 1;
+    }
+    int ret = 0;
+    *bytes = 0;
+    for (int i = 0; i < n; ++i) {
+        struct stat st;
+        if (!ret && !fstatat(AT_FDCWD, join_path(indir, ents[i]->d_name), &st, 0)) {
+            ret = crypt_file(enc, key, indir, outdir, ents[i]->d_name, NULL, 0);
+            *bytes += st.st_size;
+        }
+        free(ents[i]);
+    }
+    free(ents);
+    memset(key, 0, sizeof(key));
+    return ret;
+}
+
+// ENCRYPTED_NAME lists the images the engine encrypted, after the cipher.
+// Those of an earlier checkpoint into the same directory that are still
+// encrypted, as CRIU did not write them again, are not part of this image,
+// and encrypting them again would make them undecryptable. Other files are
+// left alone.
+static void remove_stale_images(const char *imagedir) {
+    FILE *in = fopen(join_path(imagedir, ENCRYPTED_NAME), "r");
+    if (!in) {
+        return;
+    }
+    char line[NAME_MAX + 2];
+    bool header = true;
+    while (fgets(line, sizeof(line), in)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (header || !line[0] || strchr(line, '/')) {
+            header = false;
+            continue;
+        }
+        const char *path = join_path(imagedir, line);
+        char magic[sizeof(ENCRYPT_MAGIC) - 1];
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        bool stale = 0 <= fd && read_full(fd, magic, sizeof(magic)) && !memcmp(magic, ENCRYPT_MAGIC, sizeof(magic));
+        if (0 <= fd) {
+            close(fd);
+        }
+        if (stale) {
+            fprintf(stderr, "Removing %s left over by an earlier checkpoint\n", line);
+            unlink(path);
+        }
+    }
+    fclose(in);
+}
+
+static int encrypt_images(const char *imagedir) {
+    long long bytes;
+    long long start = realtime_ns();
+    remove_stale_images(imagedir);
+    if (crypt_images(true, imagedir, imagedir, is_image_file, &bytes)) {
+        return 1;
+    }
+    FILE *out = fopen(join_path(imagedir, ENCRYPTED_NAME), "w");
+    if (!out) {
+        fprintf(stderr, "Cannot mark %s encrypted: %s\n", imagedir, strerror(errno));
+        return 1;
+    }
+    fprintf(out, "aes-256-gcm %d\n", ENCRYPT_BLOCK);
+    struct dirent **ents;
+    int n = scandir(imagedir, &ents, is_image_file, alphasort);
+    for (int i = 0; i < n; ++i) {
+        fprintf(out, "%s\n", ents[i]->d_name);
+        free(ents[i]);
+    }
+    if (0 <= n) {
+        free(ents);
+    }
+    if (fclose(out) || n < 0) {
+        fprintf(stderr, "Cannot mark %s encrypted: %s\n", imagedir, strerror(errno));
+        return 1;
+    }
+    long long ns = realtime_ns() - start;
+    fprintf(stderr, "Encrypted %lld bytes in %.3f s (%.0f MB/s)\n", bytes, ns / 1e9, bytes * 1e3 / (ns ? ns : 1));
+    return 0;
+}
+
+static void remove_dir(const char *path) {
+    DIR *dir = opendir(path);
+    if (dir) {
+        struct dirent *ent;
+        while ((ent = readdir(dir))) {
+            unlinkat(dirfd(dir), ent->d_name, 0);
+        }
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+// Decrypts the images but the pages images into a private directory for
+// CRIU to restore from, see decrypt_pages for those. Returns the directory
+// or NULL on failure.
+static const char *decrypt_images(const char *imagedir) {
+    const char *base = getenv(DECRYPT_DIR_ENV);
+    char *tmpl;
+    if (asprintf(&tmpl, "%s/crac-restore-XXXXXX", base ? base : "/dev/shm") < 0 || !mkdtemp(tmpl)) {
+        fprintf(stderr, "Cannot create directory for decrypted images: %s\n", strerror(errno));
+        return NULL;
+    }
+    long long bytes;
+    if (crypt_images(false, imagedir, tmpl, is_metadata_image, &bytes)) {
+        remove_dir(tmpl);
+        return NULL;
+    }
+    setenv(DECRYPTED_ENV, tmpl, 1);
+
+    // Plain images must not outlive the restore. On success post-resume
+    // removes them; if CRIU fails, this watcher does once CRIU is gone.
+    pid_t criu = getpid();
+    pid_t child = fork();
+    if (!child) {
+        if (fork()) {
+            exit(0);
+        }
+        await_criu(criu, tmpl);
+        remove_dir(tmpl);
+        exit(0);
+    }
+    if (0 < child) {
+        waitpid(child, NULL, 0);
+    }
+    return tmpl;
+}
+
+static long long clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Saves the clocks at the time JVM was frozen for restore to continue from
+static void write_clocks(const char *imagedir, long long monotonic, long long boottime) {
+    FILE *out = fopen(join_path(imagedir, CLOCKS_NAME), "w");
+    if (!out) {
+        fprintf(stderr, "Cannot save clocks in %s: %s\n", imagedir, strerror(errno));
+        return;
+    }
+    fprintf(out, "monotonic %lld\nboottime %lld\n", monotonic, boottime);
+    fclose(out);
+}
+
+static void format_offset(char *buf, size_t len, const char *clock, long long offset_ns) {
+    // timens_offsets wants a non-negative nanosecond part
+    long long sec = offset_ns / 1000000000LL;
+    long long nsec = offset_ns % 1000000000LL;
+    if (nsec < 0) {
+        sec -= 1;
+        nsec += 1000000000LL;
+    }
+    snprintf(buf, len, "%s %lld %lld\n", clock, sec, nsec);
+}
+
+// Creates a time namespace with shifted CLOCK_MONOTONIC and CLOCK_BOOTTIME
+// for the JVM, so deadlines armed before checkpoint don't all expire at once
+// on restore. unshare(CLONE_NEWTIME) leaves the caller where it is and puts
+// only children created afterwards in the new namespace: the processes CRIU
+// forks to restore the JVM, not this process. The offsets are written
+// before any child exists, as the kernel requires.
+static void setup_timens(const char *imagedir) {
+    const char *mode = getenv(TIMENS_ENV);
+    if (!mode) {
+        return;
+    }
+
+    long long monotonic_offset, boottime_offset;
+    if (!strcmp(mode, "auto")) {
+        long long monotonic = -1, boottime = -1;
+        FILE *in = fopen(join_path(imagedir, CLOCKS_NAME), "r");
+        if (in) {
+            if (fscanf(in, "monotonic %lld boottime %lld", &monotonic, &boottime) != 2) {
+                monotonic = -1;
+            }
+            fclose(in);
+        }
+        if (monotonic < 0) {
+            fprintf(stderr, "No saved clocks in %s, restoring without time namespace\n", imagedir);
+            return;
+        }
+        monotonic_offset = monotonic - clock_ns(CLOCK_MONOTONIC);
+        boottime_offset = boottime - clock_ns(CLOCK_BOOTTIME);
+    } else {
+        char *end;
+        double secs = strtod(mode, &end);
+        if (*end || end == mode) {
+            fprintf(stderr, "Invalid %s=%s, expected 'auto' or seconds\n", TIMENS_ENV, mode);
+            return;
+        }
+        monotonic_offset = boottime_offset = (long long)(secs * 1e9);
+    }
+
+    if (unshare(CLONE_NEWTIME)) {
+        fprintf(stderr, "Cannot create time namespace, restoring without it: %s\n", strerror(errno));
+        return;
+    }
+    char offsets[128];
+    format_offset(offsets, sizeof(offsets) / 2, "monotonic", monotonic_offset);
+    format_offset(offsets + strlen(offsets), sizeof(offsets) / 2, "boottime", boottime_offset);
+    int fd = open("/proc/self/timens_offsets", O_WRONLY | O_CLOEXEC);
+    if (fd < 0 || !write_full(fd, offsets, strlen(offsets))) {
+        fprintf(stderr, "Cannot set time namespace offsets: %s\n", strerror(errno));
+    } else {
+        setenv(TIMENS_USED_ENV, mode, 1);
+    }
+    if (0 <= fd) {
+        close(fd);
+    }
+}
+
+// CPU time and context switches of all threads of a process
+static bool read_activity(pid_t pid, long long *cpu_ns, long long *ctxsw) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    char buf[1024];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+    // comm may have spaces, fields are counted from the closing parenthesis
+    char *p = strrchr(buf, ')');
+    unsigned long long utime, stime;
+    if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2) {
+        return false;
+    }
+    *cpu_ns = (utime + stime) * (1000000000LL / sysconf(_SC_CLK_TCK));
+
+    *ctxsw = 0;
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    DIR *dir = opendir(path);
+    if (dir) {
+        struct dirent *ent;
+        while ((ent = readdir(dir))) {
+            char status[PATH_MAX];
+            snprintf(status, sizeof(status), "/proc/%d/task/%s/status", pid, ent->d_name);
+            FILE *sf = ent->d_name[0] != '.' ? fopen(status, "r") : NULL;
+            if (!sf) {
+                continue;
+            }
+            char line[128];
+            long long n;
+            while (fgets(line, sizeof(line), sf)) {
+                if (sscanf(line, "voluntary_ctxt_switches: %lld", &n) == 1
+                        || sscanf(line, "nonvoluntary_ctxt_switches: %lld", &n) == 1) {
+                    *ctxsw += n;
+                }
+            }
+            fclose(sf);
+        }
+        closedir(dir);
+    }
+    return true;
+}
+
+// Measures how busy the JVM is right after it was kicked, which is where
+// timers and deadlines that expired during the downtime fire
+static void measure_timer_burst(pid_t pid) {
+    const char *window = getenv(TIMER_BURST_ENV);
+    if (!window || pid <= 0) {
+        return;
+    }
+    long long cpu0, ctxsw0, cpu1, ctxsw1;
+    if (!read_activity(pid, &cpu0, &ctxsw0)) {
+        return;
+    }
+    long long window_ns = atoll(window) * 1000000LL;
+    struct timespec ts = { window_ns / 1000000000LL, window_ns % 1000000000LL };
+    while (nanosleep(&ts, &ts) && errno == EINTR);
+    if (!read_activity(pid, &cpu1, &ctxsw1)) {
+        return;
+    }
+    fprintf(stderr, MSGPREFIX "Timer burst: %.1f ms CPU, %lld context switches in first %s ms after restore\n",
+            (cpu1 - cpu0) / 1e6, ctxsw1 - ctxsw0, window);
+    metrics_record("op=timerburst result=ok class=none window_ns=%lld cpu_ns=%lld ctxsw=%lld",
+            window_ns, cpu1 - cpu0, ctxsw1 - ctxsw0);
+}
+
+static long long read_limit(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    long long value = -1;
+    char buf[64];
+    if (fgets(buf, sizeof(buf), f) && strncmp(buf, "max", 3)) {
+        value = atoll(buf);
+    }
+    fclose(f);
+    return value;
+}
+
+// Memory (in MiB) and CPUs available to this process, taking cgroup v2 or
+// v1 limits into account
+static void resource_limits(long long *mem_mb, int *cpus) {
+    long long mem = (long long)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+    cpu_set_t set;
+    *cpus = sched_getaffinity(0, sizeof(set), &set) ? (int)sysconf(_SC_NPROCESSORS_ONLN) : CPU_COUNT(&set);
+
+    char cgroup[PATH_MAX] = "";
+    FILE *f = fopen("/proc/self/cgroup", "r");
+    if (f) {
+        char line[PATH_MAX];
+        while (fgets(line, sizeof(line), f)) {
+            if (!strncmp(line, "0::", 3)) {
+                snprintf(cgroup, sizeof(cgroup), "%s", line + 3);
+                cgroup[strcspn(cgroup, "\n")] = '\0';
+            }
+        }
+        fclose(f);
+    }
+
+    struct stat st;
+    if (cgroup[0] && !stat("/sys/fs/cgroup/cgroup.controllers", &st)) {
+        // v2: the tightest limit on the way up to the root applies
+        for (;;) {
+            char path[PATH_MAX + 64];
+            snprintf(path, sizeof(path), "/sys/fs/cgroup%s/memory.max", cgroup);
+            long long limit = read_limit(path);
+            if (0 < limit && limit < mem) {
+                mem = limit;
+            }
+            snprintf(path, sizeof(path), "/sys/fs/cgroup%s/cpu.max", cgroup);
+            FILE *cf = fopen(path, "r");
+            long long quota, period;
+            if (cf) {
+                if (fscanf(cf, "%lld %lld", &quota, &period) == 2 && 0 < period) {
+                    int limit_cpus = (quota + period - 1) / period;
+                    if (0 < limit_cpus && limit_cpus < *cpus) {
+                        *cpus = limit_cpus;
+                    }
+                }
+                fclose(cf);
+            }
+            char *slash = strrchr(cgroup, '/');
+            if (!slash || !cgroup[1]) {
+                break;
+            }
+            slash[slash == cgroup ? 1 : 0] = '\0';
+        }
+    } else {
+        long long limit = read_limit("/sys/fs/cgroup/memory/memory.limit_in_bytes");
+        if (0 < limit && limit < mem) {
+            mem = limit;
+        }
+        long long quota = read_limit("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+        long long period = read_limit("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+        if (0 < quota && 0 < period) {
+            int limit_cpus = (quota + period - 1) / period;
+            if (limit_cpus < *cpus) {
+                *cpus = limit_cpus;
+            }
+        }
+    }
+    *mem_mb = mem >> 20;
+}
+
+// Variants are keyed by a class rather than exact limits: memory rounded
+// down to a power of two, so that e.g. 3.9G and 4G containers share one
+static const char *variant_name(void) {
+    long long mem_mb;
+    int cpus;
+    resource_limits(&mem_mb, &cpus);
+    long long mem_class = 1;
+    while (mem_class * 2 <= mem_mb) {
+        mem_class *= 2;
+    }
+    char *name;
+    if (asprintf(&name, VARIANT_FORMAT, mem_class, cpus) < 0) {
+        perror("asprintf");
+        exit(1);
+    }
+    return name;
+}
+
+static const char *checkpoint_variant(const char *imagedir) {
+    const char *dir = join_path(imagedir, variant_name());
+    if (mkdir(dir, 0755) && errno != EEXIST) {
+        fprintf(stderr, "Cannot create image variant %s: %s\n", dir, strerror(errno));
+        return imagedir;
+    }
+    return dir;
+}
+
+// Picks the variant to restore: the largest memory class that fits the
+// current limits, then the most CPUs that fit. If no variant fits, the
+// smallest one is used. Returns imagedir if it has no variants.
+static const char *restore_variant(const char *imagedir) {
+    DIR *dir = opendir(imagedir);
+    if (!dir) {
+        return imagedir;
+    }
+    long long mem_mb;
+    int cpus;
+    resource_limits(&mem_mb, &cpus);
+
+    char best[NAME_MAX + 1] = "", smallest[NAME_MAX + 1] = "";
+    long long best_mem = -1, small_mem = -1;
+    int best_cpus = -1, small_cpus = -1;
+    struct dirent *ent;
+    while ((ent = readdir(dir))) {
+        long long vmem;
+        int vcpus;
+        if (sscanf(ent->d_name, VARIANT_FORMAT, &vmem, &vcpus) != 2) {
+            continue;
+        }
+        if (vmem <= mem_mb && vcpus <= cpus
+                && (vmem > best_mem || (vmem == best_mem && vcpus > best_cpus))) {
+            best_mem = vmem;
+            best_cpus = vcpus;
+            strcpy(best, ent->d_name);
+        }
+        if (small_mem < 0 || vmem < small_mem || (vmem == small_mem && vcpus < small_cpus)) {
+            small_mem = vmem;
+            small_cpus = vcpus;
+            strcpy(smallest, ent->d_name);
+        }
+    }
+    closedir(dir);
+
+    if (best[0]) {
+        return join_path(imagedir, best);
+    }
+    if (smallest[0]) {
+        fprintf(stderr, "No image variant fits %lldM memory and %d CPUs, using %s\n", mem_mb, cpus, smallest);
+        return join_path(imagedir, smallest);
+    }
+    return imagedir;
+}
+
+// Just enough protobuf to pick fields out of CRIU images without libprotobuf-c
+struct pb {
+    const unsigned char *p;
+    const unsigned char *end;
+};
+
+static bool pb_varint(struct pb *b, uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; b->p < b->end && shift < 64; shift += 7) {
+        unsigned char c = *b->p++;
+        *value |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Reads the next field: varints and fixed-size values go to *value,
+// length-delimited ones to *sub
+static bool pb_next(struct pb *b, uint32_t *field, uint64_t *value, struct pb *sub) {
+    uint64_t key, len;
+    if (b->p >= b->end || !pb_varint(b, &key)) {
+        return false;
+    }
+    *field = key >> 3;
+    *value = 0;
+    switch (key & 7) {
+    case 0:
+        return pb_varint(b, value);
+    case 1:
+    case 5: {
+        size_t size = (key & 7) == 1 ? 8 : 4;
+        if ((size_t)(b->end - b->p) < size) {
+            return false;
+        }
+        memcpy(value, b->p, size); // little-endian only, as CRIU itself
+        b->p += size;
+        return true;
+    }
+    case 2:
+        if (!pb_varint(b, &len) || len > (uint64_t)(b->end - b->p)) {
+            return false;
+        }
+        sub->p = b->p;
+        sub->end = b->p + len;
+        b->p += len;
+        return true;
+    default:
+        return false;
+    }
+}
+
+struct dump_stats {
+    long long freezing_us;
+    long long frozen_us;
+    long long memdump_us;
+    long long memwrite_us;
+    long long pages_written;
+};
+
+// Reads the dump part of the stats-dump CRIU writes at the end of dump
+static bool read_dump_stats(const char *imagedir, struct dump_stats *stats) {
+    int fd = open(join_path(imagedir, STATS_DUMP_NAME), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    unsigned char buf[512];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    close(fd);
+    uint32_t head[3];
+    if (n < (ssize_t)sizeof(head)) {
+        return false;
+    }
+    memcpy(head, buf, sizeof(head));
+    if (head[0] != IMG_SERVICE_MAGIC || head[1] != STATS_MAGIC || head[2] > n - sizeof(head)) {
+        return false;
+    }
+
+    struct pb entry = { buf + sizeof(head), buf + sizeof(head) + head[2] };
+    struct pb dump = { NULL, NULL }, sub;
+    uint32_t field;
+    uint64_t value;
+    while (pb_next(&entry, &field, &value, &sub)) {
+        if (field == 1) { // StatsEntry.dump
+            dump = sub;
+        }
+    }
+    if (!dump.p) {
+        return false;
+    }
+    memset(stats, 0, sizeof(*stats));
+    while (pb_next(&dump, &field, &value, &sub)) {
+        switch (field) {
+        case 1: stats->freezing_us = value; break;
+        case 2: stats->frozen_us = value; break;
+        case 3: stats->memdump_us = value; break;
+        case 4: stats->memwrite_us = value; break;
+        case 7: stats->pages_written = value; break;
+        }
+    }
+    return true;
+}
+
+// Offline pagemap optimization, see optimize()
+#define OPTIMIZE_FILL_ENV "CRAC_OPTIMIZE_FILL_PCT"
+
+// CRIU image magics and flags, for optimize() and diff()
+#define IMG_COMMON_MAGIC 0x54564319
+#define PAGEMAP_MAGIC 0x56084025
+#define MM_MAGIC 0x57492820
+#define PE_PARENT (1 << 0)
+#define PE_LAZY (1 << 1)
+#define PE_PRESENT (1 << 2)
+#define VMA_AREA_REGULAR (1 << 0)
+#define VMA_AREA_STACK (1 << 1)
+#define VMA_AREA_VSYSCALL (1 << 2)
+#define VMA_AREA_VDSO (1 << 3)
+#define VMA_AREA_HEAP (1 << 5)
+#define VMA_FILE_PRIVATE (1 << 6)
+#define VMA_FILE_SHARED (1 << 7)
+#define VMA_ANON_SHARED (1 << 8)
+#define VMA_ANON_PRIVATE (1 << 9)
+#define VMA_AREA_VVAR (1 << 12)
+#define HUGE_PAGE_SIZE (2ULL << 20)
+
+// Next "u32 length, message" record of an image
+static bool pb_record(struct pb *img, struct pb *msg) {
+    uint32_t len;
+    if ((size_t)(img->end - img->p) < sizeof(len)) {
+        return false;
+    }
+    memcpy(&len, img->p, sizeof(len));
+    if (len > (size_t)(img->end - img->p) - sizeof(len)) {
+        return false;
+    }
+    msg->p = img->p + sizeof(len);
+    msg->end = msg->p + len;
+    img->p = msg->end;
+    return true;
+}
+
+static unsigned char *pb_put(unsigned char *p, uint32_t field, uint64_t value) {
+    for (uint64_t v = (uint64_t)field << 3; ; v >>= 7) { // wire type 0
+        *p++ = (v & 0x7f) | (v > 0x7f ? 0x80 : 0);
+        if (v <= 0x7f) {
+            break;
+        }
+    }
+    for (;; value >>= 7) {
+        *p++ = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+        if (value <= 0x7f) {
+            return p;
+        }
+    }
+}
+
+// Reads a whole image and checks its magic; the records follow *img
+static unsigned char *read_image(const char *imagedir, const char *name, uint32_t magic, struct pb *img) {
+    errno = 0;
+    int fd = open(join_path(imagedir, name), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    unsigned char *buf = NULL;
+    uint32_t head[2];
+    if (fd < 0 || fstat(fd, &st) || st.st_size < (off_t)sizeof(head)
+            || !(buf = malloc(st.st_size)) || !read_full(fd, buf, st.st_size)) {
+        fprintf(stderr, "Cannot read %s: %s\n", name, errno ? strerror(errno) : "truncated");
+        free(buf);
+        buf = NULL;
+    }
+    if (0 <= fd) {
+        close(fd);
+    }
+    if (!buf) {
+        return NULL;
+    }
+    memcpy(head, buf, sizeof(head));
+    if (head[0] != IMG_COMMON_MAGIC || head[1] != magic) {
+        fprintf(stderr, "Unexpected magic in %s\n", name);
+        free(buf);
+        return NULL;
+    }
+    img->p = buf + sizeof(head);
+    img->end = buf + st.st_size;
+    return buf;
+}
+
+struct page_run {
+    uint64_t vaddr;
+    uint64_t nr_pages;
+    uint32_t flags;
+    long long offset; // in the pages image, or -1 for zeroes
+};
+
+struct vma {
+    uint64_t start;
+    uint64_t end;
+    uint64_t status; // VMA_* flags
+};
+
+// VMAs of mm-<id>.img in address order
+static struct vma *read_vmas(const char *imagedir, unsigned long long id, size_t *n) {
+    char name[64];
+    snprintf(name, sizeof(name), "mm-%llu.img", id);
+    struct pb img, mm, sub, vma;
+    unsigned char *buf = read_image(imagedir, name, MM_MAGIC, &img);
+    if (!buf) {
+        return NULL;
+    }
+    struct vma *vmas = NULL;
+    size_t cap = 0;
+    uint32_t field;
+    uint64_t value;
+    *n = 0;
+    if (pb_record(&img, &mm)) {
+        while (pb_next(&mm, &field, &value, &vma)) {
+            if (field != 14) { // MmEntry.vmas
+                continue;
+            }
+            struct vma v = { 0, 0, 0 };
+            while (pb_next(&vma, &field, &value, &sub)) {
+                switch (field) {
+                case 1: v.start = value; break;
+                case 2: v.end = value; break;
+                case 7: v.status = value; break;
+                }
+            }
+            if (*n == cap && !(vmas = realloc(vmas, (cap = cap ? 2 * cap : 64) * sizeof(*vmas)))) {
+                perror("realloc");
+                exit(1);
+            }
+            vmas[(*n)++] = v;
+        }
+    }
+    free(buf);
+    return vmas ? vmas : malloc(sizeof(*vmas));
+}
+
+// Zero runs that complete the 2 MiB blocks of anonymous private VMAs that
+// are populated at least fill_pct percent, so that they restore as single
+// runs and may be backed by huge pages. Pages absent from the pagemap of
+// such VMAs read as zeroes, so this does not change the memory contents.
+// Fill runs take the flags of the block, which must all be the same and
+// have the pages in this image: CRIU marks anonymous pages PE_LAZY on top
+// of PE_PRESENT even for eager restore. Blocks with pages in a parent image
+// are left alone.
+static struct page_run *fill_runs(const struct page_run *runs, size_t n, const struct vma *vmas, size_t nvmas,
+        uint64_t page, int fill_pct, size_t *nfills) {
+    struct page_run *fills = NULL;
+    size_t cap = 0, j = 0;
+    *nfills = 0;
+    for (size_t v = 0; v < nvmas; ++v) {
+        if ((vmas[v].status & (VMA_AREA_REGULAR | VMA_ANON_PRIVATE)) != (VMA_AREA_REGULAR | VMA_ANON_PRIVATE)) {
+            continue;
+        }
+        for (uint64_t block = vmas[v].start & ~(HUGE_PAGE_SIZE - 1); block < vmas[v].end; block += HUGE_PAGE_SIZE) {
+            uint64_t lo = block < vmas[v].start ? vmas[v].start : block;
+            uint64_t hi = block + HUGE_PAGE_SIZE > vmas[v].end ? vmas[v].end : block + HUGE_PAGE_SIZE;
+            while (j < n && runs[j].vaddr + runs[j].nr_pages * page <= lo) {
+                ++j;
+            }
+            uint64_t present = 0;
+            uint32_t flags = j < n ? runs[j].flags : 0;
+            bool plain = (flags & (PE_PRESENT | PE_PARENT)) == PE_PRESENT;
+            for (size_t k = j; k < n && runs[k].vaddr < hi; ++k) {
+                uint64_t start = runs[k].vaddr < lo ? lo : runs[k].vaddr;
+                uint64_t end = runs[k].vaddr + runs[k].nr_pages * page;
+                present += (end > hi ? hi : end) - start;
+                plain &= runs[k].flags == flags;
+            }
+            if (!present || present == hi - lo || !plain || present * 100 < fill_pct * (hi - lo)) {
+                continue;
+            }
+            uint64_t cursor = lo;
+            for (size_t k = j; cursor < hi; ++k) {
+                uint64_t start = k < n && runs[k].vaddr < hi ? runs[k].vaddr : hi;
+                if (start > cursor) {
+                    if (*nfills == cap && !(fills = realloc(fills, (cap = cap ? 2 * cap : 64) * sizeof(*fills)))) {
+                        perror("realloc");
+                        exit(1);
+                    }
+                    fills[(*nfills)++] = (struct page_run){ cursor, (start - cursor) / page, flags, -1 };
+                }
+                if (start < hi) {
+                    uint64_t end = runs[k].vaddr + runs[k].nr_pages * page;
+                    cursor = end > cursor ? end : cursor;
+                } else {
+                    cursor = hi;
+                }
+            }
+        }
+    }
+    return fills;
+}
+
+// Appends a PagemapEntry record
+static unsigned char *put_entry(unsigned char *m, const struct page_run *r) {
+    unsigned char *e = m + sizeof(uint32_t);
+    e = pb_put(e, 1, r->vaddr);
+    e = pb_put(e, 2, r->nr_pages);
+    e = pb_put(e, 4, r->flags);
+    uint32_t len = e - m - sizeof(uint32_t);
+    memcpy(m, &len, sizeof(len));
+    return e;
+}
+
+static bool copy_pages(int from, long long offset, int to, long long len, unsigned char *buf) {
+    while (len > 0) {
+        size_t chunk = len < ENCRYPT_BLOCK ? len : ENCRYPT_BLOCK;
+        ssize_t r = pread(from, buf, chunk, offset);
+        if (r <= 0 || !write_full(to, buf, r)) {
+            return false;
+        }
+        offset += r;
+        len -= r;
+    }
+    return true;
+}
+
+// Entries of pagemap-<id>.img, with the offsets of their pages in
+// pages-<*pages_id>.img
+static struct page_run *read_pagemap(const char *imagedir, unsigned long long id, uint64_t page,
+        unsigned long long *pages_id, size_t *n) {
+    char name[64];
+    snprintf(name, sizeof(name), "pagemap-%llu.img", id);
+    struct pb img, head, entry, sub;
+    unsigned char *buf = read_image(imagedir, name, PAGEMAP_MAGIC, &img);
+    if (!buf) {
+        return NULL;
+    }
+
+    uint32_t field;
+    uint64_t value;
+    if (!pb_record(&img, &head)) {
+        fprintf(stderr, "Malformed %s\n", name);
+        free(buf);
+        return NULL;
+    }
+    *pages_id = 0;
+    while (pb_next(&head, &field, &value, &sub)) {
+        if (field == 1) { // PagemapHead.pages_id
+            *pages_id = value;
+        }
+    }
+
+    size_t cap = 1024;
+    struct page_run *runs = malloc(cap * sizeof(*runs));
+    long long offset = 0;
+    *n = 0;
+    while (runs && pb_record(&img, &entry)) {
+        struct page_run r = { 0, 0, 0, -1 };
+        bool has_flags = false, in_parent = false;
+        while (pb_next(&entry, &field, &value, &sub)) {
+            switch (field) {
+            case 1: r.vaddr = value; break;
+            case 2: r.nr_pages = value; break;
+            case 3: in_parent = value; break;
+            case 4: r.flags = value; has_flags = true; break;
+            }
+        }
+        if (!has_flags) { // images of older CRIU
+            r.flags = in_parent ? PE_PARENT : PE_PRESENT;
+        }
+        if (r.flags & PE_PRESENT) {
+            r.offset = offset;
+            offset += r.nr_pages * page;
+        }
+        if (*n == cap && !(runs = realloc(runs, (cap *= 2) * sizeof(*runs)))) {
+            break;
+        }
+        runs[(*n)++] = r;
+    }
+    if (!runs) {
+        perror("realloc");
+        exit(1);
+    }
+    free(buf);
+    return runs;
+}
+
+// Rewrites pagemap-<id>.img and its pages image into maximal runs. Adds
+// the bytes of zero pages filled in to *filled and of the pages it had to
+// *present.
+static int optimize_pagemap(const char *imagedir, unsigned long long id, int fill_pct,
+        size_t *entries_before, size_t *entries_after, long long *filled, long long *present) {
+    char name[64], pages_name[64];
+    snprintf(name, sizeof(name), "pagemap-%llu.img", id);
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    unsigned long long pages_id;
+    size_t n;
+    struct page_run *runs = read_pagemap(imagedir, id, page, &pages_id, &n);
+    if (!runs) {
+        return 1;
+    }
+    snprintf(pages_name, sizeof(pages_name), "pages-%llu.img", pages_id);
+    for (size_t i = 1; i < n; ++i) {
+        if (runs[i].vaddr < runs[i - 1].vaddr + runs[i - 1].nr_pages * page) {
+            fprintf(stderr, "%s is not sorted, leaving it as is\n", name);
+            free(runs);
+            return 0;
+        }
+    }
+
+    size_t nvmas = 0, nfills = 0;
+    struct vma *vmas = fill_pct <= 100 ? read_vmas(imagedir, id, &nvmas) : NULL;
+    struct page_run *fills = vmas ? fill_runs(runs, n, vmas, nvmas, page, fill_pct, &nfills) : NULL;
+    free(vmas);
+
+    const char *pages_path = join_path(imagedir, pages_name);
+    const char *pages_tmp = join_path(imagedir, "pages.img.tmp");
+    const char *pagemap_path = join_path(imagedir, name);
+    const char *pagemap_tmp = join_path(imagedir, "pagemap.img.tmp");
+    int from = open(pages_path, O_RDONLY | O_CLOEXEC);
+    int to = open(pages_tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    unsigned char *copybuf = malloc(ENCRYPT_BLOCK);
+    // every output entry is at most 3 fields of a key and a 10-byte varint
+    unsigned char *map = malloc(3 * sizeof(uint32_t) + 11 + (n + nfills) * (sizeof(uint32_t) + 3 * 11));
+    int ret = 0;
+    if (from < 0 || to < 0 || !copybuf || !map) {
+        fprintf(stderr, "Cannot rewrite %s: %s\n", pages_name, strerror(errno));
+        ret = 1;
+    }
+
+    // Merge the original and fill runs in address order, copying the pages
+    // and coalescing contiguous runs of the same kind into one entry
+    unsigned char *m = map;
+    if (!ret) {
+        uint32_t magic[3] = { IMG_COMMON_MAGIC, PAGEMAP_MAGIC, 0 };
+        unsigned char *e = pb_put(m + sizeof(magic), 1, pages_id);
+        magic[2] = e - m - sizeof(magic);
+        memcpy(m, magic, sizeof(magic));
+        m = e;
+    }
+    struct page_run last = { 0, 0, 0, -1 };
+    long long written = 0;
+    *filled = 0;
+    for (size_t i = 0, k = 0; !ret && (i < n || k < nfills); ) {
+        const struct page_run *r = k == nfills || (i < n && runs[i].vaddr < fills[k].vaddr) ? &runs[i++] : &fills[k++];
+        uint64_t len = r->nr_pages * page;
+        errno = 0;
+        if (r->offset >= 0 && !copy_pages(from, r->offset, to, len, copybuf)) {
+            fprintf(stderr, "Cannot copy %s: %s\n", pages_name, errno ? strerror(errno) : "truncated");
+            ret = 1;
+        } else if (r->offset < 0 && (r->flags & PE_PRESENT)) {
+            lseek(to, len, SEEK_CUR); // left as a hole
+            *filled += len;
+        }
+        written += r->flags & PE_PRESENT ? len : 0;
+
+        if (last.nr_pages && last.flags == r->flags && last.vaddr + last.nr_pages * page == r->vaddr) {
+            last.nr_pages += r->nr_pages;
+        } else {
+            if (last.nr_pages) {
+                m = put_entry(m, &last);
+                ++*entries_after;
+            }
+            last = *r;
+        }
+    }
+    if (!ret && last.nr_pages) {
+        m = put_entry(m, &last);
+        ++*entries_after;
+    }
+    *entries_before += n;
+
+    *present += written - *filled;
+    if (!ret && ftruncate(to, written)) {
+        fprintf(stderr, "Cannot write %s: %s\n", pages_name, strerror(errno));
+        ret = 1;
+    }
+    if (0 <= to && close(to) && !ret) {
+        fprintf(stderr, "Cannot write %s: %s\n", pages_name, strerror(errno));
+        ret = 1;
+    }
+    if (!ret) {
+        int fd = open(pagemap_tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0 || !write_full(fd, map, m - map) || close(fd)) {
+            fprintf(stderr, "Cannot write %s: %s\n", name, strerror(errno));
+            ret = 1;
+        }
+    }
+    // The pages image goes first: a pagemap never refers past its end
+    if (!ret && (rename(pages_tmp, pages_path) || rename(pagemap_tmp, pagemap_path))) {
+        fprintf(stderr, "Cannot replace %s: %s\n", name, strerror(errno));
+        ret = 1;
+    }
+    if (ret) {
+        unlink(pages_tmp);
+        unlink(pagemap_tmp);
+    }
+    if (0 <= from) {
+        close(from);
+    }
+    free(map);
+    free(copybuf);
+    free(fills);
+    free(runs);
+    return ret;
+}
+
+// pagemap-<id>.img of a process, not of shared memory
+static int is_pagemap(const struct dirent *ent) {
+    unsigned long long id;
+    int len = 0;
+    return sscanf(ent->d_name, "pagemap-%llu.img%n", &id, &len) == 1 && len && !ent->d_name[len];
+}
+
+// Rewrites the pagemap and pages images of imagedir so that restore reads
+// fewer, larger runs: adjacent entries are coalesced, and gaps in mostly
+// populated 2 MiB blocks of anonymous private memory are filled with zero
+// pages (holes in the pages image), see fill_runs. OPTIMIZE_FILL_ENV sets
+// the population threshold in percent, default 50; above 100 disables the
+// filling. Restore makes the filled pages resident like any other, so they
+// cost their size in memory unless huge pages would have backed the whole
+// block anyway; fill_rss_pct is that growth of the restored memory.
+static int optimize(const char *imagedir) {
+    if (!imagedir) {
+        fprintf(stderr, "image directory is not specified\n");
+        return 1;
+    }
+    struct stat st;
+    if (!stat(join_path(imagedir, ENCRYPTED_NAME), &st)) {
+        fprintf(stderr, "%s is encrypted, optimize it before encryption\n", imagedir);
+        return 1;
+    }
+    const char *fillstr = getenv(OPTIMIZE_FILL_ENV);
+    int fill_pct = fillstr ? atoi(fillstr) : 50;
+
+    struct dirent **ents;
+    int n = scandir(imagedir, &ents, is_pagemap, alphasort);
+    if (n <= 0) {
+        fprintf(stderr, "No pagemap images in %s\n", imagedir);
+        return 1;
+    }
+    long long start = realtime_ns();
+    size_t before = 0, after = 0;
+    long long filled = 0, present = 0;
+    int ret = 0;
+    for (int i = 0; i < n; ++i) {
+        unsigned long long id = strtoull(ents[i]->d_name + strlen("pagemap-"), NULL, 10);
+        long long f = 0;
+        if (!ret && optimize_pagemap(imagedir, id, fill_pct, &before, &after, &f, &present)) {
+            ret = 1;
+        }
+        filled += f;
+        free(ents[i]);
+    }
+    free(ents);
+
+    // Sizes and contents changed
+    if (!ret && !stat(join_path(imagedir, CHECKSUMS_NAME), &st) && write_checksums(imagedir)) {
+        ret = 1;
+    }
+    long long duration = realtime_ns() - start;
+    double fill_rss_pct = present ? 100.0 * filled / present : 0.0;
+    fprintf(stderr, "%s: %zu pagemap entries -> %zu (%.1f%% fewer), %lld bytes zero-filled "
+            "(+%.1f%% resident memory on restore), %.3f s\n",
+            ret ? "FAILED" : "OK", before, after, before ? 100.0 * (before - after) / before : 0.0,
+            filled, fill_rss_pct, duration / 1e9);
+    metrics_record("op=optimize result=%s class=%s duration_ns=%lld entries_before=%zu entries_after=%zu fill_bytes=%lld"
+            " fill_rss_pct=%.1f",
+            ret ? "fail" : "ok", ret ? "rewrite" : "none", duration, before, after, filled, fill_rss_pct);
+    return ret;
+}
+
+enum region {
+    REGION_ANON_PRIVATE,
+    REGION_ANON_SHARED,
+    REGION_FILE_PRIVATE,
+    REGION_FILE_SHARED,
+    REGION_HEAP,
+    REGION_STACK,
+    REGION_VDSO,
+    REGION_OTHER,
+    REGION_COUNT
+};
+
+static const char *const region_names[REGION_COUNT] = {
+    "anon_private", "anon_shared", "file_private", "file_shared", "heap", "stack", "vdso", "other"
+};
+
+static enum region region_of(uint64_t status) {
+    if (status & VMA_AREA_HEAP) {
+        return REGION_HEAP; // brk, the Java heap is anon_private
+    } else if (status & VMA_AREA_STACK) {
+        return REGION_STACK;
+    } else if (status & (VMA_AREA_VSYSCALL | VMA_AREA_VDSO | VMA_AREA_VVAR)) {
+        return REGION_VDSO;
+    } else if (status & VMA_ANON_PRIVATE) {
+        return REGION_ANON_PRIVATE;
+    } else if (status & VMA_ANON_SHARED) {
+        return REGION_ANON_SHARED;
+    } else if (status & VMA_FILE_PRIVATE) {
+        return REGION_FILE_PRIVATE;
+    } else if (status & VMA_FILE_SHARED) {
+        return REGION_FILE_SHARED;
+    }
+    return REGION_OTHER;
+}
+
+struct page_hash {
+    unsigned long long id; // of the process
+    uint64_t vaddr;
+    uint64_t hash;
+    uint64_t vma_start;
+    uint64_t vma_end;
+    enum region region;
+    bool unresolved; // in a parent image that is not there
+};
+
+struct image_pages {
+    struct page_hash *pages;
+    size_t n;
+    size_t cap;
+    struct image_pages *parent;
+    bool parent_loaded;
+};
+
+static int page_hash_cmp(const void *a, const void *b) {
+    const struct page_hash *x = a, *y = b;
+    if (x->id != y->id) {
+        return x->id < y->id ? -1 : 1;
+    }
+    return x->vaddr < y->vaddr ? -1 : x->vaddr > y->vaddr;
+}
+
+// 64 bits out of the hardware CRC32C of both halves of the page
+static uint64_t hash_page(const unsigned char *p, uint64_t page) {
+    return (uint64_t)crc32c(p, page / 2) << 32 | crc32c(p + page / 2, page / 2);
+}
+
+static bool hash_image(const char *imagedir, struct image_pages *img);
+
+// Takes the hash of a page from the parent image, which CRIU links as
+// "parent" in an incremental image directory
+static bool parent_hash(const char *imagedir, struct image_pages *img, struct page_hash *ph) {
+    if (!img->parent_loaded) {
+        img->parent_loaded = true;
+        const char *parentdir = join_path(imagedir, "parent");
+        struct stat st;
+        if (!stat(parentdir, &st) && (img->parent = calloc(1, sizeof(*img->parent)))
+                && !hash_image(parentdir, img->parent)) {
+            free(img->parent);
+            img->parent = NULL;
+        }
+    }
+    const struct page_hash *found = img->parent
+        ? bsearch(ph, img->parent->pages, img->parent->n, sizeof(*ph), page_hash_cmp) : NULL;
+    if (!found || found->unresolved) {
+        return false;
+    }
+    ph->hash = found->hash;
+    return true;
+}
+
+static void add_page(struct image_pages *img, const struct page_hash *ph) {
+    if (img->n == img->cap
+            && !(img->pages = realloc(img->pages, (img->cap = img->cap ? 2 * img->cap : 4096) * sizeof(*ph)))) {
+        perror("realloc");
+        exit(1);
+    }
+    img->pages[img->n++] = *ph;
+}
+
+// Hashes every page of every process of imagedir, sorted by process and address
+static bool hash_image(const char *imagedir, struct image_pages *img) {
+    struct dirent **ents;
+    int n = scandir(imagedir, &ents, is_pagemap, alphasort);
+    if (n < 0) {
+        fprintf(stderr, "Cannot list %s: %s\n", imagedir, strerror(errno));
+        return false;
+    }
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    unsigned char *buf = malloc(ENCRYPT_BLOCK);
+    bool ok = buf != NULL;
+    for (int i = 0; i < n; ++i) {
+        unsigned long long id = strtoull(ents[i]->d_name + strlen("pagemap-"), NULL, 10);
+        free(ents[i]);
+        unsigned long long pages_id;
+        size_t nruns, nvmas = 0;
+        struct page_run *runs = ok ? read_pagemap(imagedir, id, page, &pages_id, &nruns) : NULL;
+        struct vma *vmas = runs ? read_vmas(imagedir, id, &nvmas) : NULL;
+        char pages_name[64];
+        snprintf(pages_name, sizeof(pages_name), "pages-%llu.img", runs ? pages_id : 0);
+        int fd = vmas ? open(join_path(imagedir, pages_name), O_RDONLY | O_CLOEXEC) : -1;
+        if (fd < 0) {
+            if (vmas) {
+                fprintf(stderr, "Cannot open %s: %s\n", pages_name, strerror(errno));
+            }
+            ok = false;
+        }
+
+        size_t v = 0;
+        for (size_t r = 0; ok && r < nruns; ++r) {
+            for (uint64_t k = 0; ok && k < runs[r].nr_pages; ) {
+                struct page_hash ph = { id, runs[r].vaddr + k * page, 0, 0, 0, REGION_OTHER, false };
+                if (v >= nvmas || ph.vaddr < vmas[v].start || vmas[v].end <= ph.vaddr) {
+                    v = 0;
+                    while (v < nvmas && vmas[v].end <= ph.vaddr) {
+                        ++v;
+                    }
+                }
+                if (v < nvmas && vmas[v].start <= ph.vaddr) {
+                    ph.vma_start = vmas[v].start;
+                    ph.vma_end = vmas[v].end;
+                    ph.region = region_of(vmas[v].status);
+                }
+                if (!(runs[r].flags & PE_PRESENT)) {
+                    ph.unresolved = !(runs[r].flags & PE_PARENT) || !parent_hash(imagedir, img, &ph);
+                    add_page(img, &ph);
+                    ++k;
+                    continue;
+                }
+                uint64_t count = runs[r].nr_pages - k;
+                if (count > ENCRYPT_BLOCK / page) {
+                    count = ENCRYPT_BLOCK / page;
+                }
+                // Runs can cross VMAs (criuengine optimize merges them), so
+                // the chunk stops where the region of its first page does
+                uint64_t bound = v >= nvmas ? 0 : vmas[v].start <= ph.vaddr ? vmas[v].end : vmas[v].start;
+                if (bound && count > (bound - ph.vaddr) / page) {
+                    count = (bound - ph.vaddr) / page;
+                }
+                if (pread(fd, buf, count * page, runs[r].offset + k * page) != (ssize_t)(count * page)) {
+                    fprintf(stderr, "Cannot read %s\n", pages_name);
+                    ok = false;
+                    break;
+                }
+                for (uint64_t j = 0; j < count; ++j, ph.vaddr += page) {
+                    ph.hash = hash_page(buf + j * page, page);
+                    add_page(img, &ph);
+                }
+                k += count;
+            }
+        }
+        if (0 <= fd) {
+            close(fd);
+        }
+        free(vmas);
+        free(runs);
+    }
+    free(ents);
+    free(buf);
+    if (ok) {
+        qsort(img->pages, img->n, sizeof(*img->pages), page_hash_cmp);
+    }
+    return ok;
+}
+
+static void free_image_pages(struct image_pages *img) {
+    if (img->parent) {
+        free_image_pages(img->parent);
+        free(img->parent);
+    }
+    free(img->pages);
+}
+
+struct region_diff {
+    long long a_bytes;
+    long long b_bytes;
+    long long added;
+    long long removed;
+    long long changed;
+    long long unchanged;
+    long long unresolved; // in a missing parent image, not compared
+};
+
+#define TOP_VMAS 10
+
+// Growth of a VMA of B: bytes added or changed against A
+struct vma_diff {
+    unsigned long long id;
+    uint64_t start;
+    uint64_t end;
+    enum region region;
+    long long added;
+    long long changed;
+};
+
+static void top_vmas_add(struct vma_diff *top, int *ntop, const struct vma_diff *d) {
+    if (!d->added && !d->changed) {
+        return;
+    }
+    int i = *ntop < TOP_VMAS ? (*ntop)++ : TOP_VMAS - 1;
+    if (i == TOP_VMAS - 1 && top[i].added + top[i].changed >= d->added + d->changed) {
+        return;
+    }
+    for (; i > 0 && top[i - 1].added + top[i - 1].changed < d->added + d->changed; --i) {
+        top[i] = top[i - 1];
+    }
+    top[i] = *d;
+}
+
+static void print_json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') {
+            fprintf(out, "\\%c", *s);
+        } else if ((unsigned char)*s < 0x20) {
+            fprintf(out, "\\u%04x", *s);
+        } else {
+            fputc(*s, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void print_region_diff(FILE *out, const struct region_diff *d) {
+    fprintf(out, "{\"a_bytes\": %lld, \"b_bytes\": %lld, \"added\": %lld, \"removed\": %lld, "
+            "\"changed\": %lld, \"unchanged\": %lld, \"unresolved\": %lld}",
+            d->a_bytes, d->b_bytes, d->added, d->removed, d->changed, d->unchanged, d->unresolved);
+}
+
+static void print_image(FILE *out, const char *name, const char *imagedir, const struct region_diff *total) {
+    fprintf(out, "  \"%s\": {\"path\": ", name);
+    print_json_string(out, imagedir);
+    fprintf(out, ", \"image_bytes\": %lld, \"page_bytes\": %lld},\n", dir_size(imagedir),
+            name[0] == 'a' ? total->a_bytes : total->b_bytes);
+}
+
+// Compares the memory of two images page by page and prints, as JSON on
+// stdout, the bytes added, removed and changed in B per kind of VMA, and
+// the VMAs of B that grew the most. Pages are matched by process and
+// address; pages kept in a parent image are taken from it.
+static int diff(const char *imagedir_a, const char *imagedir_b) {
+    if (!imagedir_a || !imagedir_b) {
+        fprintf(stderr, "usage: criuengine diff IMAGEDIR_A IMAGEDIR_B\n");
+        return 1;
+    }
+    struct image_pages a = { NULL, 0, 0, NULL, false }, b = { NULL, 0, 0, NULL, false };
+    if (!hash_image(imagedir_a, &a) || !hash_image(imagedir_b, &b)) {
+        free_image_pages(&a);
+        free_image_pages(&b);
+        return 1;
+    }
+
+    long long page = sysconf(_SC_PAGESIZE);
+    struct region_diff regions[REGION_COUNT], total;
+    memset(regions, 0, sizeof(regions));
+    memset(&total, 0, sizeof(total));
+    struct vma_diff top[TOP_VMAS] = {{ 0 }}, cur = { 0, 0, 0, REGION_OTHER, 0, 0 };
+    int ntop = 0;
+    for (size_t i = 0, j = 0; i < a.n || j < b.n; ) {
+        int cmp = i == a.n ? 1 : j == b.n ? -1 : page_hash_cmp(&a.pages[i], &b.pages[j]);
+        const struct page_hash *pa = cmp <= 0 ? &a.pages[i++] : NULL;
+        const struct page_hash *pb = cmp >= 0 ? &b.pages[j++] : NULL;
+        struct region_diff *d = &regions[pb ? pb->region : pa->region];
+        long long *counter;
+        if (!pb) {
+            counter = &d->removed;
+        } else if (pb->unresolved || (pa && pa->unresolved)) {
+            counter = &d->unresolved;
+        } else if (!pa) {
+            counter = &d->added;
+        } else {
+            counter = pa->hash == pb->hash ? &d->unchanged : &d->changed;
+        }
+        *counter += page;
+        d->a_bytes += pa ? page : 0;
+        d->b_bytes += pb ? page : 0;
+
+        if (pb && (counter == &d->added || counter == &d->changed)) {
+            if (cur.id != pb->id || cur.start != pb->vma_start) {
+                top_vmas_add(top, &ntop, &cur);
+                cur = (struct vma_diff){ pb->id, pb->vma_start, pb->vma_end, pb->region, 0, 0 };
+            }
+            *(counter == &d->added ? &cur.added : &cur.changed) += page;
+        }
+    }
+    top_vmas_add(top, &ntop, &cur);
+
+    for (int r = 0; r < REGION_COUNT; ++r) {
+        total.a_bytes += regions[r].a_bytes;
+        total.b_bytes += regions[r].b_bytes;
+        total.added += regions[r].added;
+        total.removed += regions[r].removed;
+        total.changed += regions[r].changed;
+        total.unchanged += regions[r].unchanged;
+        total.unresolved += regions[r].unresolved;
+    }
+
+    printf("{\n");
+    print_image(stdout, "a", imagedir_a, &total);
+    print_image(stdout, "b", imagedir_b, &total);
+    printf("  \"page_size\": %lld,\n  \"regions\": {\n", page);
+    bool first = true;
+    for (int r = 0; r < REGION_COUNT; ++r) {
+        if (regions[r].a_bytes || regions[r].b_bytes) {
+            printf("%s    \"%s\": ", first ? "" : ",\n", region_names[r]);
+            print_region_diff(stdout, &regions[r]);
+            first = false;
+        }
+    }
+    printf("\n  },\n  \"total\": ");
+    print_region_diff(stdout, &total);
+    printf(",\n  \"top_vmas\": [");
+    for (int i = 0; i < ntop; ++i) {
+        printf("%s\n    {\"pid\": %llu, \"start\": \"0x%" PRIx64 "\", \"end\": \"0x%" PRIx64 "\", "
+                "\"region\": \"%s\", \"added\": %lld, \"changed\": %lld}",
+                i ? "," : "", top[i].id, top[i].start, top[i].end, region_names[top[i].region],
+                top[i].added, top[i].changed);
+    }
+    printf("%s]\n}\n", ntop ? "\n  " : "");
+
+    free_image_pages(&a);
+    free_image_pages(&b);
+    return 0;
+}
+
+// Restore cost model: the latency of a restore mode is a fixed part plus a
+// part driven by the image's bytes. The latter comes from the image and
+// from measurements of this host: storage read, CRC32C, AES-GCM and memory
+// copy throughput, and CPUs. The fixed part, CRIU's and the JVM's own work,
+// and a scale of the latter are fitted from the restore records of the
+// image in METRICS_ENV. predict saves the fit only to a file it is given,
+// such as COST_MODEL_NAME of the image, which it reads for hosts that have
+// no records.
+#define COST_MODEL_NAME "restore-cost-model"
+#define PROBE_BYTES (64 << 20)
+
+enum restore_mode { MODE_RESTORE, MODE_VERIFY, MODE_ENCRYPTED, MODE_EAGER, MODE_TIMENS, MODE_PIDNS, MODE_COUNT };
+
+static const char *mode_names[MODE_COUNT] = { "restore", "verify", "encrypted", "eager", "timens", "pidns" };
+
+// Per-byte costs in ns
+struct host_costs {
+    double read;
+    double crc;
+    double aes; // 0 without libcrypto
+    double copy;
+    int cpus;
+};
+
+// latency = fixed_ns of the mode + scale * variable_ns of the mode
+struct cost_model {
+    double scale;
+    double fixed_ns[MODE_COUNT];
+    int samples[MODE_COUNT];
+};
+
+// Reads up to PROBE_BYTES of the images as they are cached now
+static double probe_read(const char *imagedir, double fallback) {
+    struct dirent **ents;
+    int n = scandir(imagedir, &ents, is_image_file, alphasort);
+    char *buf = malloc(1 << 20);
+    long long bytes = 0;
+    long long start = clock_ns(CLOCK_MONOTONIC);
+    for (int i = 0; i < n; ++i) {
+        int fd = buf && bytes < PROBE_BYTES ? open(join_path(imagedir, ents[i]->d_name), O_RDONLY | O_CLOEXEC) : -1;
+        if (0 <= fd) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            ssize_t r;
+            while (bytes < PROBE_BYTES && 0 < (r = read(fd, buf, 1 << 20))) {
+                bytes += r;
+            }
+            close(fd);
+        }
+        free(ents[i]);
+    }
+    long long ns = clock_ns(CLOCK_MONOTONIC) - start;
+    if (0 <= n) {
+        free(ents);
+    }
+    free(buf);
+    // Too little to time, the read costs no more than a copy then
+    return bytes < (1 << 20) ? fallback : (double)ns / bytes;
+}
+
+static void probe_host(const char *imagedir, bool aes, struct host_costs *host) {
+    long long mem_mb;
+    resource_limits(&mem_mb, &host->cpus);
+
+    size_t len = 16 << 20;
+    unsigned char *src = malloc(len);
+    if (!src) {
+        fprintf(stderr, "Cannot allocate probe buffer\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < len; ++i) {
+        src[i] = (unsigned char)(i * 2654435761u >> 24);
+    }
+    void *ctx = aes && load_crypto() ? evp.ctx_new() : NULL;
+    static const unsigned char key[32], iv[12];
+
+    // Best of a few runs, as other work on the host only slows them down
+    host->copy = host->crc = host->aes = 0;
+    for (int run = 0; run < 3; ++run) {
+        // Into fresh memory, to include the page faults restore takes too
+        unsigned char *dst = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (dst == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+        long long start = clock_ns(CLOCK_MONOTONIC);
+        memcpy(dst, src, len);
+        double copy = (double)(clock_ns(CLOCK_MONOTONIC) - start) / len;
+        host->copy = run && host->copy < copy ? host->copy : copy;
+
+        start = clock_ns(CLOCK_MONOTONIC);
+        volatile uint32_t sum = crc32c(src, len);
+        (void)sum;
+        double crc = (double)(clock_ns(CLOCK_MONOTONIC) - start) / len;
+        host->crc = run && host->crc < crc ? host->crc : crc;
+
+        int outlen;
+        start = clock_ns(CLOCK_MONOTONIC);
+        if (ctx && evp.decrypt_init(ctx, evp.aes_256_gcm(), NULL, key, iv)) {
+            for (size_t off = 0; off < len; off += ENCRYPT_BLOCK) {
+                evp.decrypt_update(ctx, dst + off, &outlen, src + off, ENCRYPT_BLOCK);
+            }
+            double dec = (double)(clock_ns(CLOCK_MONOTONIC) - start) / len;
+            host->aes = run && host->aes < dec ? host->aes : dec;
+        }
+        munmap(dst, len);
+    }
+    if (ctx) {
+        evp.ctx_free(ctx);
+    }
+    free(src);
+
+    host->read = probe_read(imagedir, host->copy);
+}
+
+// The part of the latency of mode driven by the bytes of the image, lazy
+// the bytes the injector copies with threads
+static double variable_ns(enum restore_mode mode, bool encrypted, const struct host_costs *host,
+        long long bytes, long long lazy, int threads) {
+    // CRIU reads decrypted images from memory
+    double src = encrypted ? host->copy : host->read;
+    double ns = bytes * (src + host->copy);
+    if (encrypted) {
+        ns += bytes * (host->read + host->aes + host->copy);
+    }
+    if (mode == MODE_VERIFY) {
+        // The verifier reads along with CRIU and is waited for after it
+        ns += bytes * host->crc;
+    } else if (mode == MODE_EAGER && 0 < threads) {
+        threads = threads < host->cpus ? threads : host->cpus;
+        double per_byte = (src + host->copy) / threads;
+        ns -= lazy * (src + host->copy - (per_byte > src ? per_byte : src));
+    }
+    return ns;
+}
+
+static enum restore_mode parse_mode(const char *name) {
+    for (int m = 0; m < MODE_COUNT; ++m) {
+        if (!strcmp(name, mode_names[m])) {
+            return (enum restore_mode)m;
+        }
+    }
+    return MODE_COUNT;
+}
+
+struct restore_sample {
+    enum restore_mode mode;
+    double duration_ns;
+    double variable_ns;
+};
+
+// Fits the model to the successful restore records of the image by least
+// squares: one scale of the costs probed on this host, which are off by
+// how much of them CRIU overlaps, and a fixed part per mode. Returns the
+// number of records used.
+static int fit_records(const char *path, const char *image, const struct host_costs *host, struct cost_model *model) {
+    FILE *in = path ? fopen(path, "r") : NULL;
+    if (!in) {
+        return 0;
+    }
+    struct restore_sample *samples = NULL;
+    size_t n = 0, cap = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), in)) {
+        char op[32] = "", result[32] = "", mode[32] = "", id[64] = "";
+        long long duration = -1, image_bytes = -1, lazy = 0;
+        int threads = 0;
+        char *save;
+        for (char *tok = strtok_r(line, " \n", &save); tok; tok = strtok_r(NULL, " \n", &save)) {
+            sscanf(tok, "op=%31s", op);
+            sscanf(tok, "result=%31s", result);
+            sscanf(tok, "mode=%31s", mode);
+            sscanf(tok, "duration_ns=%lld", &duration);
+            sscanf(tok, "image=%63s", id);
+            sscanf(tok, "image_bytes=%lld", &image_bytes);
+            sscanf(tok, "uffd_bytes=%lld", &lazy);
+            sscanf(tok, "uffd_threads=%d", &threads);
+        }
+        // Records of other images, of combined modes, or older ones without
+        // a mode or an image, don't count. Encrypted restores inject lazy
+        // pages eagerly by default, which is part of the mode.
+        enum restore_mode m = !strcmp(mode, "encrypted+eager") ? MODE_ENCRYPTED : parse_mode(mode);
+        if (strcmp(op, "restore") || strcmp(result, "ok") || strcmp(id, image) || m == MODE_COUNT || duration < 0
+                || image_bytes < 0) {
+            continue;
+        }
+        if (n == cap) {
+            cap = cap ? 2 * cap : 64;
+            struct restore_sample *grown = realloc(samples, cap * sizeof(*samples));
+            if (!grown) {
+                break;
+            }
+            samples = grown;
+        }
+        samples[n++] = (struct restore_sample){ m, duration,
+                variable_ns(m, m == MODE_ENCRYPTED, host, image_bytes, lazy, threads) };
+    }
+    fclose(in);
+
+    double mean_t[MODE_COUNT] = { 0 }, mean_v[MODE_COUNT] = { 0 };
+    for (size_t i = 0; i < n; ++i) {
+        mean_t[samples[i].mode] += samples[i].duration_ns;
+        mean_v[samples[i].mode] += samples[i].variable_ns;
+        ++model->samples[samples[i].mode];
+    }
+    for (int m = 0; m < MODE_COUNT; ++m) {
+        mean_t[m] /= model->samples[m] ? model->samples[m] : 1;
+        mean_v[m] /= model->samples[m] ? model->samples[m] : 1;
+    }
+    // Records of images of one size leave the scale open, the probes stand then
+    double cov = 0, var = 0;
+    for (size_t i = 0; i < n; ++i) {
+        double dv = samples[i].variable_ns - mean_v[samples[i].mode];
+        cov += dv * (samples[i].duration_ns - mean_t[samples[i].mode]);
+        var += dv * dv;
+    }
+    model->scale = 0 < var && 0 < cov ? cov / var : 1;
+    for (int m = 0; m < MODE_COUNT; ++m) {
+        double fixed = mean_t[m] - model->scale * mean_v[m];
+        model->fixed_ns[m] = model->samples[m] && 0 < fixed ? fixed : 0;
+    }
+    free(samples);
+    return (int)n;
+}
+
+static void write_cost_model(const char *path, const struct cost_model *model) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Cannot save %s: %s\n", path, strerror(errno));
+        return;
+    }
+    fprintf(out, "scale %g\n", model->scale);
+    for (int m = 0; m < MODE_COUNT; ++m) {
+        if (model->samples[m]) {
+            fprintf(out, "%s %.0f %d\n", mode_names[m], model->fixed_ns[m], model->samples[m]);
+        }
+    }
+    fclose(out);
+}
+
+// Returns false if there is no model at path
+static bool read_cost_model(const char *path, struct cost_model *model) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        return false;
+    }
+    char line[128], name[32];
+    double value;
+    int samples;
+    while (fgets(line, sizeof(line), in)) {
+        enum restore_mode m;
+        if (sscanf(line, "scale %lf", &value) == 1 && 0 < value) {
+            model->scale = value;
+        } else if (sscanf(line, "%31s %lf %d", name, &value, &samples) == 3
+                && (m = parse_mode(name)) != MODE_COUNT && 0 < samples) {
+            model->fixed_ns[m] = value;
+            model->samples[m] = samples;
+        }
+    }
+    fclose(in);
+    return true;
+}
+
+// Prints, as JSON on stdout, the expected restore latency of imagedir, or
+// of the variant of it restore would pick, in every mode on this host.
+// Restore records of the image in METRICS_ENV refit the model, which is
+// saved to model_path if given; without records, it is read from
+// model_path, or else from the image. Modes without records of their own
+// take the fixed part of plain restore.
+static int predict(const char *imagedir, const char *model_path) {
+    if (!imagedir) {
+        fprintf(stderr, "usage: criuengine predict IMAGEDIR [MODEL]\n");
+        return 1;
+    }
+    imagedir = restore_variant(imagedir);
+    long long bytes = dir_size(imagedir);
+    if (bytes < 0) {
+        fprintf(stderr, "Cannot read %s: %s\n", imagedir, strerror(errno));
+        return 1;
+    }
+    struct stat st;
+    bool encrypted = !stat(join_path(imagedir, ENCRYPTED_NAME), &st);
+    bool checksums = !stat(join_path(imagedir, CHECKSUMS_NAME), &st);
+
+    // Present lazy pages are the ones the injector copies
+    long long lazy = 0;
+    if (!encrypted) {
+        struct dirent **ents;
+        int n = scandir(imagedir, &ents, is_pagemap, alphasort);
+        uint64_t page = sysconf(_SC_PAGESIZE);
+        for (int i = 0; i < n; ++i) {
+            unsigned long long pages_id;
+            size_t nruns = 0;
+            struct page_run *runs = read_pagemap(imagedir,
+                    strtoull(ents[i]->d_name + strlen("pagemap-"), NULL, 10), page, &pages_id, &nruns);
+            for (size_t r = 0; runs && r < nruns; ++r) {
+                if ((runs[r].flags & PE_LAZY) && (runs[r].flags & PE_PRESENT)) {
+                    lazy += runs[r].nr_pages * page;
+                }
+            }
+            free(runs);
+            free(ents[i]);
+        }
+        if (0 <= n) {
+            free(ents);
+        }
+    }
+
+    struct host_costs host;
+    probe_host(imagedir, encrypted, &host);
+    const char *threadsenv = getenv(UFFD_THREADS_ENV);
+    int threads = threadsenv && 0 < atoi(threadsenv) ? atoi(threadsenv) : host.cpus;
+
+    struct cost_model model;
+    memset(&model, 0, sizeof(model));
+    model.scale = 1;
+    char id[64];
+    if (image_id(imagedir, id, sizeof(id)) && fit_records(getenv(METRICS_ENV), id, &host, &model)) {
+        if (model_path) {
+            write_cost_model(model_path, &model);
+        }
+    } else if (!read_cost_model(model_path ? model_path : join_path(imagedir, COST_MODEL_NAME), &model)) {
+        fprintf(stderr, "No restore records of %s in %s, nor a cost model, to predict from\n", imagedir, METRICS_ENV);
+        return 1;
+    }
+
+    printf("{\n  \"image\": {\"path\": ");
+    print_json_string(stdout, imagedir);
+    printf(", \"image_bytes\": %lld, \"lazy_bytes\": %lld, \"encrypted\": %s, \"checksums\": %s},\n",
+            bytes, lazy, encrypted ? "true" : "false", checksums ? "true" : "false");
+    printf("  \"host\": {\"cpus\": %d, \"read_mb_s\": %.0f, \"crc32c_mb_s\": %.0f, \"aes_gcm_mb_s\": %.0f, "
+            "\"copy_mb_s\": %.0f},\n  \"scale\": %.3f,\n", host.cpus, 1e3 / host.read, 1e3 / host.crc,
+            host.aes ? 1e3 / host.aes : 0, 1e3 / host.copy, model.scale);
+    printf("  \"modes\": {");
+    for (int m = 0; m < MODE_COUNT; ++m) {
+        // Modes without records of their own take the fixed part of plain
+        // restore, eager that of encrypted on encrypted images, which it is
+        // by default
+        int fit = model.samples[m] ? m : encrypted && m == MODE_EAGER && model.samples[MODE_ENCRYPTED]
+            ? MODE_ENCRYPTED : MODE_RESTORE;
+        // An encrypted image is decrypted whatever the mode
+        double ns = model.fixed_ns[fit]
+                + model.scale * variable_ns((enum restore_mode)m, encrypted, &host, bytes, lazy, threads);
+        bool applicable = m == MODE_ENCRYPTED ? encrypted && host.aes
+                : m == MODE_VERIFY ? checksums
+                : m == MODE_EAGER ? (encrypted ? host.aes != 0 : lazy != 0)
+                : true;
+        printf("%s\n    \"%s\": {\"latency_ms\": %.1f, \"fixed_ms\": %.1f, \"samples\": %d, \"applicable\": %s}",
+                m ? "," : "", mode_names[m], ns / 1e6, model.fixed_ns[fit] / 1e6, model.samples[m],
+                applicable ? "true" : "false");
+    }
+    printf("\n  }\n}\n");
+    return 0;
+}
+
+// Eager restore of lazy pages: CRIU restores with --lazy-pages and hands
+// the userfaultfd of every restored process to a detached injector, which
+// copies the lazy pages from the image with UFFD_THREADS_ENV threads while
+// serving the faults that come before it is done. post-resume waits for
+// it before the JVM is kicked, so the JVM never runs on missing memory.
+
+// Non-cooperative event seen during injection
+struct inject_event {
+    uint64_t from;
+    uint64_t to; // 0 if the range is gone
+    uint64_t len;
+};
+
+struct inject_task {
+    int pid;
+    int uffd;
+    int nthreads;
+    int pages_fd;
+    char pages_name[64];
+    const unsigned char *key; // if the pages image is encrypted
+    struct enc_header hdr;
+    uint64_t page;
+    struct page_run *runs; // lazy ones
+    size_t n;
+    size_t next_run; // work not taken yet, under lock
+    uint64_t next_page;
+    struct inject_event *events;
+    size_t nevents;
+    size_t events_cap;
+    long long copied;
+    bool failed;
+    bool done;
+    int wake; // eventfd, signalled once done is set
+    pthread_mutex_t lock;
+    // Held shared across each copy of the workers, and exclusively by the
+    // fault handler from reading a message to recording its event: once
+    // read, an event no longer fails copies with EAGAIN, and the process
+    // goes on to zap the range, which a copy must not fill again
+    pthread_rwlock_t copying;
+};
+
+// Where a page of the image is now, after the events; false if it is gone
+static bool inject_translate(struct inject_task *t, uint64_t *addr) {
+    pthread_mutex_lock(&t->lock);
+    bool present = true;
+    for (size_t i = 0; present && i < t->nevents; ++i) {
+        const struct inject_event *e = &t->events[i];
+        if (e->from <= *addr && *addr < e->from + e->len) {
+            present = e->to != 0;
+            *addr = e->to + (*addr - e->from);
+        }
+    }
+    pthread_mutex_unlock(&t->lock);
+    return present;
+}
+
+// Where a page is in the image, the inverse of inject_translate; false if
+// the process has removed it since (MADV_DONTNEED, munmap), so that it
+// reads as zeroes and not as the image
+static bool inject_untranslate(struct inject_task *t, uint64_t *addr) {
+    pthread_mutex_lock(&t->lock);
+    bool present = true;
+    for (size_t i = t->nevents; present && i > 0; --i) {
+        const struct inject_event *e = &t->events[i - 1];
+        if (!e->to) {
+            present = *addr < e->from || e->from + e->len <= *addr;
+        } else if (e->to <= *addr && *addr < e->to + e->len) {
+            *addr = e->from + (*addr - e->to);
+        }
+    }
+    pthread_mutex_unlock(&t->lock);
+    return present;
+}
+
+// Reads the pages image of a task, decrypting it if it is encrypted. One
+// per thread, as it keeps the last block decrypted.
+struct pages_reader {
+    void *ctx;
+    unsigned char *cipher;
+    unsigned char *plain;
+    uint64_t index; // of the block in plain, UINT64_MAX if none
+};
+
+static bool reader_init(struct pages_reader *rd, const struct inject_task *t) {
+    memset(rd, 0, sizeof(*rd));
+    rd->index = UINT64_MAX;
+    if (!t->key) {
+        return true;
+    }
+    rd->cipher = malloc(ENCRYPT_BLOCK + GCM_TAG_SIZE);
+    rd->plain = malloc(ENCRYPT_BLOCK);
+    return rd->cipher && rd->plain && (rd->ctx = crypt_ctx(false, t->key));
+}
+
+static void reader_free(struct pages_reader *rd) {
+    if (rd->ctx) {
+        evp.ctx_free(rd->ctx);
+    }
+    free(rd->cipher);
+    free(rd->plain);
+}
+
+// Reads len bytes at off of the plain pages image
+static bool read_pages(struct inject_task *t, struct pages_reader *rd, unsigned char *dst, uint64_t off, uint64_t len) {
+    if (!t->key) {
+        if (pread(t->pages_fd, dst, len, off) != (ssize_t)len) {
+            fprintf(stderr, "Cannot read %s for %d: %s\n", t->pages_name, t->pid, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+    while (len) {
+        uint64_t index = off / ENCRYPT_BLOCK;
+        if (index >= enc_blocks(t->hdr.size)) {
+            fprintf(stderr, "Pages of %d are beyond the end of %s\n", t->pid, t->pages_name);
+            return false;
+        }
+        int blen = enc_block_len(&t->hdr, index);
+        if (rd->index != index) {
+            rd->index = UINT64_MAX;
+            if (pread(t->pages_fd, rd->cipher, blen + GCM_TAG_SIZE, enc_block_offset(index)) != blen + GCM_TAG_SIZE
+                    || !crypt_block(rd->ctx, false, &t->hdr, t->pages_name, index, rd->cipher, blen, rd->plain)) {
+                fprintf(stderr, "Image %s failed authentication (wrong key or corrupted)\n", t->pages_name);
+                return false;
+            }
+            rd->index = index;
+        }
+        uint64_t in_block = off - index * ENCRYPT_BLOCK;
+        uint64_t n = blen - in_block < len ? blen - in_block : len;
+        memcpy(dst, rd->plain + in_block, n);
+        dst += n;
+        off += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Copies len bytes to dst in the process. Pages that are already there,
+// put by the fault handler, are skipped. Returns 0 or an errno.
+static int uffd_copy(int uffd, uint64_t dst, const unsigned char *src, uint64_t len, uint64_t page,
+        long long *copied) {
+    while (len) {
+        struct uffdio_copy copy = { .dst = dst, .src = (uintptr_t)src, .len = len, .mode = 0, .copy = 0 };
+        if (!ioctl(uffd, UFFDIO_COPY, &copy)) {
+            *copied += len;
+            return 0;
+        }
+        uint64_t step;
+        if (copy.copy > 0) {
+            step = copy.copy;
+            *copied += step;
+        } else if (copy.copy == -EEXIST || errno == EEXIST) {
+            step = page;
+        } else {
+            return copy.copy < 0 ? -copy.copy : errno;
+        }
+        dst += step;
+        src += step;
+        len -= step;
+    }
+    return 0;
+}
+
+// Copies pages of the image at vaddr, following the events if there are any
+static bool inject_pages(struct inject_task *t, uint64_t vaddr, const unsigned char *buf, uint64_t len) {
+    for (;;) {
+        pthread_rwlock_rdlock(&t->copying);
+        pthread_mutex_lock(&t->lock);
+        bool moved = t->nevents > 0;
+        pthread_mutex_unlock(&t->lock);
+        int err = 0;
+        long long copied = 0;
+        if (!moved) {
+            err = uffd_copy(t->uffd, vaddr, buf, len, t->page, &copied);
+        } else {
+            for (uint64_t off = 0; !err && off < len; off += t->page) {
+                uint64_t addr = vaddr + off;
+                if (inject_translate(t, &addr)) {
+                    err = uffd_copy(t->uffd, addr, buf + off, t->page, t->page, &copied);
+                    err = err == ENOENT ? 0 : err; // unmapped, the event is on its way
+                }
+            }
+        }
+        pthread_rwlock_unlock(&t->copying);
+        __atomic_add_fetch(&t->copied, copied, __ATOMIC_RELAXED);
+        if (err != EAGAIN) {
+            if (err) {
+                fprintf(stderr, "Cannot inject pages into %d at 0x%" PRIx64 ": %s\n", t->pid, vaddr, strerror(err));
+            }
+            return !err;
+        }
+        // The memory map is changing, retry when the fault handler has
+        // seen the event
+        usleep(1000);
+    }
+}
+
+static void *inject_worker(void *arg) {
+    struct inject_task *t = arg;
+    unsigned char *buf = malloc(ENCRYPT_BLOCK);
+    struct pages_reader rd;
+    bool ok = reader_init(&rd, t) && buf != NULL;
+    while (ok) {
+        pthread_mutex_lock(&t->lock);
+        ok = !t->failed;
+        size_t r = t->next_run;
+        uint64_t first = t->next_page, count = 0;
+        if (ok && r < t->n) {
+            // Up to the end of the block of an encrypted image, so that each
+            // block is decrypted once
+            uint64_t off = t->runs[r].offset + first * t->page;
+            uint64_t max_pages = (t->key ? ENCRYPT_BLOCK - off % ENCRYPT_BLOCK : ENCRYPT_BLOCK) / t->page;
+            count = t->runs[r].nr_pages - first < max_pages ? t->runs[r].nr_pages - first : max_pages;
+            t->next_page += count;
+            if (t->next_page == t->runs[r].nr_pages) {
+                t->next_run++;
+                t->next_page = 0;
+            }
+        }
+        pthread_mutex_unlock(&t->lock);
+        if (!count) {
+            break;
+        }
+        uint64_t len = count * t->page;
+        ok = read_pages(t, &rd, buf, t->runs[r].offset + first * t->page, len)
+            && inject_pages(t, t->runs[r].vaddr + first * t->page, buf, len);
+    }
+    if (!ok) {
+        pthread_mutex_lock(&t->lock);
+        t->failed = true;
+        pthread_mutex_unlock(&t->lock);
+    }
+    reader_free(&rd);
+    free(buf);
+    return NULL;
+}
+
+// Serves the faults and events of the process until the workers are done
+static void *inject_faults(void *arg) {
+    struct inject_task *t = arg;
+    unsigned char *page = malloc(t->page);
+    struct pages_reader rd;
+    bool ready = reader_init(&rd, t) && page != NULL;
+    struct pollfd pfd[2] = { { t->uffd, POLLIN, 0 }, { t->wake, POLLIN, 0 } };
+    while (ready) {
+        int polled = poll(pfd, 2, -1);
+        pthread_mutex_lock(&t->lock);
+        bool done = t->done;
+        pthread_mutex_unlock(&t->lock);
+        if (done || (polled < 0 && errno != EINTR)) {
+            break;
+        }
+        if (polled <= 0 || !(pfd[0].revents & POLLIN)) {
+            continue;
+        }
+        pthread_rwlock_wrlock(&t->copying);
+        struct uffd_msg msg;
+        bool got = read(t->uffd, &msg, sizeof(msg)) == sizeof(msg);
+        if (got && (msg.event == UFFD_EVENT_REMAP || msg.event == UFFD_EVENT_REMOVE
+                || msg.event == UFFD_EVENT_UNMAP)) {
+            struct inject_event e;
+            if (msg.event == UFFD_EVENT_REMAP) {
+                e = (struct inject_event){ msg.arg.remap.from, msg.arg.remap.to, msg.arg.remap.len };
+            } else {
+                e = (struct inject_event){ msg.arg.remove.start, 0, msg.arg.remove.end - msg.arg.remove.start };
+            }
+            pthread_mutex_lock(&t->lock);
+            if (t->nevents == t->events_cap
+                    && !(t->events = realloc(t->events, (t->events_cap = 2 * t->events_cap + 8) * sizeof(e)))) {
+                perror("realloc");
+                exit(1);
+            }
+            t->events[t->nevents++] = e;
+            pthread_mutex_unlock(&t->lock);
+        }
+        pthread_rwlock_unlock(&t->copying);
+        if (!got) {
+            continue; // EAGAIN, another reader was faster
+        }
+        switch (msg.event) {
+        case UFFD_EVENT_PAGEFAULT: {
+            uint64_t addr = msg.arg.pagefault.address & ~(t->page - 1);
+            uint64_t image_addr = addr;
+            bool present = inject_untranslate(t, &image_addr);
+            const struct page_run *r = NULL;
+            for (size_t lo = 0, hi = present ? t->n : 0; lo < hi && !r; ) {
+                size_t mid = (lo + hi) / 2;
+                if (image_addr < t->runs[mid].vaddr) {
+                    hi = mid;
+                } else if (image_addr >= t->runs[mid].vaddr + t->runs[mid].nr_pages * t->page) {
+                    lo = mid + 1;
+                } else {
+                    r = &t->runs[mid];
+                }
+            }
+            long long copied = 0;
+            int err;
+            if (r && read_pages(t, &rd, page, r->offset + (image_addr - r->vaddr), t->page)) {
+                err = uffd_copy(t->uffd, addr, page, t->page, t->page, &copied);
+            } else {
+                // Never populated at checkpoint, or removed since
+                struct uffdio_zeropage zero = { .range = { .start = addr, .len = t->page }, .mode = 0 };
+                err = ioctl(t->uffd, UFFDIO_ZEROPAGE, &zero) && errno != EEXIST ? errno : 0;
+            }
+            __atomic_add_fetch(&t->copied, copied, __ATOMIC_RELAXED);
+            if (err && err != EAGAIN) {
+                fprintf(stderr, "Cannot serve fault of %d at 0x%" PRIx64 ": %s\n", t->pid, addr, strerror(err));
+            }
+            break;
+        }
+        case UFFD_EVENT_FORK:
+            fprintf(stderr, "Process %d forked during injection, its child gets no lazy pages\n", t->pid);
+            close(msg.arg.fork.ufd);
+            break;
+        default:
+            break; // recorded above
+        }
+    }
+    reader_free(&rd);
+    free(page);
+    return NULL;
+}
+
+// Injects the lazy pages of one process, then closes its userfaultfd: the
+// kernel serves later faults as for any memory
+static void *inject_process(void *arg) {
+    struct inject_task *t = arg;
+    int nthreads = t->nthreads;
+    pthread_t faults;
+    pthread_t *workers = calloc(nthreads, sizeof(*workers));
+    bool handler = !t->failed && !pthread_create(&faults, NULL, inject_faults, t);
+    int started = 0;
+    while (workers && handler && started < nthreads && !pthread_create(&workers[started], NULL, inject_worker, t)) {
+        ++started;
+    }
+    if (!handler || !started) {
+        fprintf(stderr, "Cannot start injection threads for %d\n", t->pid);
+        t->failed = true;
+    }
+    for (int i = 0; i < started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_mutex_lock(&t->lock);
+    t->done = true;
+    pthread_mutex_unlock(&t->lock);
+    eventfd_write(t->wake, 1);
+    if (handler) {
+        pthread_join(faults, NULL);
+    }
+    free(workers);
+    close(t->uffd);
+    if (0 <= t->wake) {
+        close(t->wake);
+    }
+    return NULL;
+}
+
+// Prepares the injection into a process from its pagemap in imagedir. The
+// pages image is read from pages_dir, and decrypted if key is set.
+static struct inject_task *inject_prepare(const char *imagedir, const char *pages_dir, const unsigned char *key,
+        int pid, int uffd, int nthreads) {
+    struct inject_task *t = calloc(1, sizeof(*t));
+    if (!t) {
+        perror("calloc");
+        exit(1);
+    }
+    t->pid = pid;
+    t->uffd = uffd;
+    t->nthreads = nthreads;
+    t->pages_fd = -1;
+    t->key = key;
+    t->page = sysconf(_SC_PAGESIZE);
+    pthread_mutex_init(&t->lock, NULL);
+    // A fault waits for the copies in flight, new ones wait for the fault
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&t->copying, &attr);
+    pthread_rwlockattr_destroy(&attr);
+    if ((t->wake = eventfd(0, EFD_CLOEXEC)) < 0) {
+        perror("eventfd");
+        t->failed = true;
+        return t;
+    }
+
+    unsigned long long pages_id;
+    size_t n;
+    if (!(t->runs = read_pagemap(imagedir, pid, t->page, &pages_id, &n))) {
+        t->failed = true;
+        return t;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (t->runs[i].flags & PE_LAZY) {
+            t->runs[t->n++] = t->runs[i];
+        }
+    }
+    snprintf(t->pages_name, sizeof(t->pages_name), "pages-%llu.img", pages_id);
+    const char *path = join_path(pages_dir, t->pages_name);
+    t->pages_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (t->pages_fd < 0 && t->n) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        t->failed = true;
+    } else if (0 <= t->pages_fd && key && !read_enc_header(t->pages_fd, path, &t->hdr)) {
+        t->failed = true;
+    }
+    return t;
+}
+
+// A userfaultfd sent by CRIU, see send_uffd() there
+static int recv_fd(int sk) {
+    char dummy;
+    struct iovec iov = { &dummy, sizeof(dummy) };
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+    if (recvmsg(sk, &msg, MSG_CMSG_CLOEXEC) <= 0) {
+        return -1;
+    }
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+    return fd;
+}
+
+// The number of processes in the image, -1 if pstree.img cannot be read
+static int image_tasks(const char *imagedir) {
+    struct pb img, entry;
+    unsigned char *buf = read_image(imagedir, "pstree.img", PSTREE_MAGIC, &img);
+    if (!buf) {
+        return -1;
+    }
+    int n = 0;
+    while (pb_record(&img, &entry)) {
+        ++n;
+    }
+    free(buf);
+    return n;
+}
+
+// Takes the place of "criu lazy-pages": receives the pid and userfaultfd
+// of every restored process and injects into each as soon as it arrives.
+// Like criu lazy-pages, it expects one entry per process of pstree.img,
+// as CRIU may keep the socket open until the restore is over.
+static void inject_daemon(int sk, const char *imagedir, const char *pages_dir, const unsigned char *key, int nthreads,
+        pid_t criu, int statusfd, const char *status) {
+    // Until CRIU connects, or exits: a pidfd of it wakes the poll then,
+    // without one (before Linux 5.3) it is checked every 100 ms
+    int pidfd = syscall(SYS_pidfd_open, criu, 0);
+    struct pollfd pfd[2] = { { sk, POLLIN, 0 }, { pidfd, POLLIN, 0 } };
+    int client = -1;
+    while (client < 0 && (0 <= pidfd ? !pfd[1].revents : !kill(criu, 0))) {
+        if (poll(pfd, 0 <= pidfd ? 2 : 1, 0 <= pidfd ? -1 : 100) > 0 && (pfd[0].revents & POLLIN)) {
+            client = accept4(sk, NULL, NULL, SOCK_CLOEXEC);
+        }
+    }
+    if (0 <= pidfd) {
+        close(pidfd);
+    }
+    close(sk);
+    unlink(LAZY_PAGES_SOCKET);
+
+    long long start = realtime_ns();
+    struct inject_task **tasks = NULL;
+    pthread_t *threads = NULL;
+    size_t ntasks = 0, cap = 0;
+    bool ok = client >= 0;
+    int expected = image_tasks(imagedir), pid;
+    for (int received = 0; ok && received != expected; ++received) {
+        if (recv(client, &pid, sizeof(pid), MSG_WAITALL) != sizeof(pid)) {
+            if (0 <= expected) {
+                fprintf(stderr, "Lazy pages of %d of %d processes received\n", received, expected);
+                ok = false;
+            }
+            break;
+        }
+        if (pid <= 0) { // a zombie, no userfaultfd follows
+            continue;
+        }
+        int uffd = recv_fd(client);
+        if (uffd < 0) {
+            fprintf(stderr, "Cannot receive userfaultfd of %d\n", pid);
+            ok = false;
+            break;
+        }
+        if (ntasks == cap) {
+            cap = cap ? 2 * cap : 8;
+            if (!(tasks = realloc(tasks, cap * sizeof(*tasks))) || !(threads = realloc(threads, cap * sizeof(*threads)))) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        tasks[ntasks] = inject_prepare(imagedir, pages_dir, key, pid, uffd, nthreads);
+        if (pthread_create(&threads[ntasks], NULL, inject_process, tasks[ntasks])) {
+            inject_process(tasks[ntasks]);
+            threads[ntasks] = pthread_self();
+        }
+        ++ntasks;
+    }
+    if (0 <= client) {
+        close(client);
+    }
+
+    long long copied = 0;
+    for (size_t i = 0; i < ntasks; ++i) {
+        if (!pthread_equal(threads[i], pthread_self())) {
+            pthread_join(threads[i], NULL);
+        }
+        ok &= !tasks[i]->failed;
+        copied += tasks[i]->copied;
+        if (0 <= tasks[i]->pages_fd) {
+            close(tasks[i]->pages_fd);
+        }
+    }
+    dprintf(statusfd, "%s %lld %lld\n", ok ? "ok" : "fail", copied, realtime_ns() - start);
+    close(statusfd);
+    // post-resume removes the status, unless CRIU fails before it runs
+    await_criu(criu, status);
+    unlink(status);
+}
+
+// Listens on LAZY_PAGES_SOCKET in the working directory, which is CRIU's
+static int lazy_pages_socket(void) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strcpy(addr.sun_path, LAZY_PAGES_SOCKET);
+    int sk = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sk < 0) {
+        return -1;
+    }
+    int ret = bind(sk, (struct sockaddr *)&addr, sizeof(addr));
+    if (ret && errno == EADDRINUSE) {
+        // Left over by a restore that failed, unless someone is listening
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (0 <= probe && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) && errno == ECONNREFUSED) {
+            unlink(LAZY_PAGES_SOCKET);
+            ret = bind(sk, (struct sockaddr *)&addr, sizeof(addr));
+        } else {
+            errno = EADDRINUSE;
+        }
+        if (0 <= probe) {
+            close(probe);
+        }
+    }
+    if (ret || listen(sk, 1)) {
+        int err = errno;
+        close(sk);
+        errno = err;
+        return -1;
+    }
+    return sk;
+}
+
+// Injector threads per process: UFFD_THREADS_ENV, by default one per CPU
+// for encrypted images, whose lazy pages the injector decrypts, else none
+static int injection_threads(bool encrypted) {
+    const char *threadsenv = getenv(UFFD_THREADS_ENV);
+    if (threadsenv || !encrypted) {
+        return threadsenv ? atoi(threadsenv) : 0;
+    }
+    long long mem_mb;
+    int cpus;
+    resource_limits(&mem_mb, &cpus);
+    return cpus;
+}
+
+// The injector reads lazy pages from this image only, not from a parent
+// image or a page server
+static bool lazy_pages_injectable(const char *imagedir) {
+    struct dirent **ents;
+    int n = scandir(imagedir, &ents, is_pagemap, alphasort);
+    bool injectable = n > 0;
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    for (int i = 0; i < n; ++i) {
+        unsigned long long pages_id;
+        size_t nruns;
+        struct page_run *runs = injectable
+            ? read_pagemap(imagedir, strtoull(ents[i]->d_name + strlen("pagemap-"), NULL, 10), page, &pages_id, &nruns)
+            : NULL;
+        injectable = runs != NULL;
+        for (size_t r = 0; injectable && r < nruns; ++r) {
+            injectable = !(runs[r].flags & PE_LAZY) || (runs[r].flags & PE_PRESENT);
+        }
+        free(runs);
+        free(ents[i]);
+    }
+    if (0 <= n) {
+        free(ents);
     }
+    return injectable;
 }
 
-static void print_command_args_to_stderr(const char **args) {
-  fprintf(stderr, "Command: ");
-  print_args_to_stderr(args);
-  fputc('\n', stderr);
+static int cmp_byte_range(const void *a, const void *b) {
+    const struct byte_range *x = a, *y = b;
+    return x->start < y->start ? -1 : x->start > y->start;
 }
 
-static const char *join_path(const char *path1, const char *path2) {
-    char *retval;
-    if (asprintf(&retval, "%s/%s", path1, path2) == -1) {
-        perror("asprintf");
-        exit(1);
+// Decrypts the pages images of the encrypted imagedir into dir, which has
+// the other images decrypted. With skip_lazy, blocks holding only lazy
+// pages are left out, for the injector to decrypt straight into the
+// processes.
+static int decrypt_pages(const char *imagedir, const char *dir, bool skip_lazy) {
+    unsigned char key[32];
+    if (!load_crypto() || !read_key(key)) {
+        return 1;
     }
-    return retval;
+
+    // Lazy ranges per pages image, from the pagemaps of the processes
+    struct lazy_ranges {
+        unsigned long long pages_id;
+        struct byte_range *ranges;
+        size_t n;
+    } *lazy = NULL;
+    size_t nlazy = 0;
+    struct dirent **ents;
+    int n = skip_lazy ? scandir(dir, &ents, is_pagemap, alphasort) : 0;
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    for (int i = 0; i < n; ++i) {
+        unsigned long long pages_id;
+        size_t nruns;
+        struct page_run *runs = read_pagemap(dir, strtoull(ents[i]->d_name + strlen("pagemap-"), NULL, 10), page,
+                &pages_id, &nruns);
+        if (runs) {
+            if (!(lazy = realloc(lazy, (nlazy + 1) * sizeof(*lazy)))
+                    || !(lazy[nlazy].ranges = malloc((nruns + 1) * sizeof(struct byte_range)))) {
+                perror("realloc");
+                exit(1);
+            }
+            struct lazy_ranges *l = &lazy[nlazy++];
+            l->pages_id = pages_id;
+            l->n = 0;
+            for (size_t r = 0; r < nruns; ++r) {
+                if ((runs[r].flags & PE_LAZY) && 0 <= runs[r].offset) {
+                    l->ranges[l->n++] = (struct byte_range){ runs[r].offset, runs[r].offset + runs[r].nr_pages * page };
+                }
+            }
+            qsort(l->ranges, l->n, sizeof(struct byte_range), cmp_byte_range);
+            size_t m = 0;
+            for (size_t r = 0; r < l->n; ++r) {
+                if (m && l->ranges[r].start <= l->ranges[m - 1].end) {
+                    if (l->ranges[m - 1].end < l->ranges[r].end) {
+                        l->ranges[m - 1].end = l->ranges[r].end;
+                    }
+                } else {
+                    l->ranges[m++] = l->ranges[r];
+                }
+            }
+            l->n = m;
+        }
+        free(runs);
+        free(ents[i]);
+    }
+    if (0 < n) {
+        free(ents);
+    }
+
+    int ret = 0;
+    n = scandir(imagedir, &ents, is_pages_image, alphasort);
+    if (n < 0) {
+        fprintf(stderr, "Cannot list %s: %s\n", imagedir, strerror(errno));
+        ret = 1;
+    }
+    for (int i = 0; i < n; ++i) {
+        unsigned long long pages_id = strtoull(ents[i]->d_name + strlen("pages-"), NULL, 10);
+        const struct lazy_ranges *l = NULL;
+        for (size_t j = 0; j < nlazy && !l; ++j) {
+            l = lazy[j].pages_id == pages_id ? &lazy[j] : NULL;
+        }
+        if (!ret) {
+            ret = crypt_file(false, key, imagedir, dir, ents[i]->d_name, l ? l->ranges : NULL, l ? l->n : 0);
+        }
+        free(ents[i]);
+    }
+    if (0 <= n) {
+        free(ents);
+    }
+    for (size_t j = 0; j < nlazy; ++j) {
+        free(lazy[j].ranges);
+    }
+    free(lazy);
+    memset(key, 0, sizeof(key));
+    return ret;
 }
 
-static const char *path_abs(const char *rel) {
-    if (rel[0] == '/') {
-        return rel;
+// Starts the injector if injection_threads asks for it and the image
+// allows. With encrypted_dir, the lazy pages are read from there and
+// decrypted. Returns true if CRIU is to restore with --lazy-pages.
+static bool start_injection(const char *imagedir, const char *encrypted_dir) {
+    int nthreads = injection_threads(encrypted_dir != NULL);
+    if (nthreads <= 0) {
+        return false;
     }
-    char *cwd = get_current_dir_name();
-    if (!cwd) {
-        perror("get_current_dir_name");
-        exit(1);
+    if (!lazy_pages_injectable(imagedir)) {
+        fprintf(stderr, "Lazy pages of %s are not all in the image, CRIU restores them\n", imagedir);
+        return false;
     }
-    return join_path(cwd, rel);
+    unsigned char key[32];
+    if (encrypted_dir && (!load_crypto() || !read_key(key))) {
+        return false;
+    }
+
+    int sk = lazy_pages_socket();
+    if (sk < 0) {
+        fprintf(stderr, "Cannot listen on %s, CRIU restores lazy pages: %s\n", LAZY_PAGES_SOCKET, strerror(errno));
+        return false;
+    }
+
+    char *status = NULL;
+    const char *tmpdir = getenv("TMPDIR");
+    if (asprintf(&status, "%s/crac-uffd-XXXXXX", tmpdir ? tmpdir : "/tmp") < 0) {
+        close(sk);
+        unlink(LAZY_PAGES_SOCKET);
+        return false;
+    }
+    int fd = mkostemp(status, O_CLOEXEC);
+    if (fd < 0 || flock(fd, LOCK_EX)) {
+        fprintf(stderr, "Cannot create injection status %s: %s\n", status, strerror(errno));
+        close(sk);
+        unlink(LAZY_PAGES_SOCKET);
+        return false;
+    }
+
+    pid_t criu = getpid();
+    pid_t child = fork();
+    if (!child) {
+        // Don't leave a child for CRIU to find
+        if (fork()) {
+            exit(0);
+        }
+        inject_daemon(sk, imagedir, encrypted_dir ? encrypted_dir : imagedir, encrypted_dir ? key : NULL, nthreads,
+                criu, fd, status);
+        exit(0);
+    }
+    memset(key, 0, sizeof(key));
+    close(sk);
+    close(fd);
+    if (child < 0) {
+        perror("fork");
+        unlink(status);
+        unlink(LAZY_PAGES_SOCKET);
+        return false;
+    }
+    waitpid(child, NULL, 0);
+    setenv(UFFD_STATUS_ENV, status, 1);
+    // For the metrics record, if the threads are the default
+    char threadsstr[16];
+    snprintf(threadsstr, sizeof(threadsstr), "%d", nthreads);
+    setenv(UFFD_THREADS_ENV, threadsstr, 0);
+    return true;
 }
 
-static const char *path_abs2(const char *rel1, const char *rel2) {
-    if (rel2[0] == '/') {
-        return rel2;
+// Returns false if injection failed, so that the JVM lacks memory
+static bool finish_injection(char *stats, size_t len) {
+    const char *status = getenv(UFFD_STATUS_ENV);
+    if (!status) {
+        return true;
     }
-    return join_path(path_abs(rel1), rel2);
+    int fd = open(status, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open injection status %s: %s\n", status, strerror(errno));
+        return false;
+    }
+    long long start = realtime_ns();
+    while (flock(fd, LOCK_SH) && errno == EINTR);
+    long long wait_ns = realtime_ns() - start;
+
+    char buf[64] = "";
+    if (read(fd, buf, sizeof(buf) - 1) < 0) {
+        buf[0] = '\0';
+    }
+    close(fd);
+    unlink(status);
+    long long bytes = 0, ns = 0;
+    sscanf(buf, "%*s %lld %lld", &bytes, &ns);
+    snprintf(stats, len, " uffd_threads=%s uffd_bytes=%lld uffd_ns=%lld uffd_wait_ns=%lld",
+            getenv(UFFD_THREADS_ENV), bytes, ns, wait_ns);
+    return !strncmp(buf, "ok ", 3);
 }
 
 static int checkpoint(pid_t jvm,
@@ -130,6 +3463,7 @@ static int checkpoint(pid_t jvm,
         return 0;
     }
 
+    long long start = realtime_ns();
     pid_t parent_before = getpid();
 
     // child
@@ -151,6 +3485,10 @@ static int checkpoint(pid_t jvm,
         exit(0);
     }
 
+    if (getenv(VARIANTS_ENV)) {
+        imagedir = checkpoint_variant(imagedir);
+    }
+
     char* leave_running = getenv("CRAC_CRIU_LEAVE_RUNNING");
 
     char jvmpidchar[32];
@@ -185,6 +3523,8 @@ static int checkpoint(pid_t jvm,
             fprintf(stderr, "Warning: too many arguments in CRAC_CRIU_OPTS (dropped from '%s')\n", criuopt);
         }
     }
+    long long frozen_monotonic = clock_ns(CLOCK_MONOTONIC);
+    long long frozen_boottime = clock_ns(CLOCK_BOOTTIME);
     pid_t child = fork();
     *arg++ = NULL;
     if (!child) {
@@ -196,41 +3536,288 @@ static int checkpoint(pid_t jvm,
     }
 
     int status;
-    if (child != wait(&status)) {
+    struct rusage usage = { 0 };
+    const char *failure = NULL;
+    if (child != wait4(child, &status, 0, &usage)) {
         fprintf(stderr, "Error waiting for CRIU: %s\n", strerror(errno));
         print_command_args_to_stderr(args);
-        kickjvm(jvm, -1);
+        failure = "wait";
     } else if (!WIFEXITED(status)) {
         fprintf(stderr, "CRIU has not properly exited, waitpid status was %d - check %s\n", status, path_abs2(imagedir, log_local));
         print_command_args_to_stderr(args);
-        kickjvm(jvm, -1);
+        failure = "signaled";
     } else if (WEXITSTATUS(status)) {
         if (WEXITSTATUS(status) != SUPPRESS_ERROR_IN_PARENT) {
             fprintf(stderr, "CRIU failed with exit code %d - check %s\n", WEXITSTATUS(status), path_abs2(imagedir, log_local));
             print_command_args_to_stderr(args);
+            failure = "exit";
+        } else {
+            failure = "exec";
         }
-        kickjvm(jvm, -1);
-    } else if (leave_running) {
+    }
+
+    if (!failure) {
+        write_clocks(imagedir, frozen_monotonic, frozen_boottime);
+        if (getenv(KEY_FILE_ENV) && encrypt_images(imagedir)) {
+            failure = "encrypt";
+        } else if (getenv(CHECKSUMS_ENV) && write_checksums(imagedir)) {
+            failure = "checksum";
+        }
+    }
+
+    char stats[256] = "";
+    struct dump_stats ds;
+    if (!failure && read_dump_stats(imagedir, &ds)) {
+        snprintf(stats, sizeof(stats), " freezing_ns=%lld frozen_ns=%lld memdump_ns=%lld memwrite_ns=%lld pages_written=%lld",
+                ds.freezing_us * 1000, ds.frozen_us * 1000, ds.memdump_us * 1000, ds.memwrite_us * 1000,
+                ds.pages_written);
+    }
+
+    long long duration = realtime_ns() - start;
+    if (!failure && leave_running) {
+        // Sizing the image is not part of the pause of a JVM left running
         kickjvm(jvm, 0);
     }
+    // Otherwise recorded before the JVM is kicked, so the record is in place
+    // by the time checkpoint returns in the JVM
+    metrics_record("op=checkpoint result=%s class=%s duration_ns=%lld image_bytes=%lld criu_maxrss_kb=%ld%s",
+            failure ? "fail" : "ok", failure ? failure : "none",
+            duration, failure ? 0 : dir_size(imagedir),
+            usage.ru_maxrss, stats);
+
+    if (failure) {
+        kickjvm(jvm, -1);
+    }
 
     exit(0);
 }
 
+static void sighandler(int sig, siginfo_t *info, void *uc) {
+    if (0 <= g_pid) {
+        kill(g_pid, sig);
+    }
+}
+
+// Passes the signals this process gets on to pid
+static void forward_signals(pid_t pid) {
+    g_pid = pid;
+
+    struct sigaction sigact;
+    sigfillset(&sigact.sa_mask);
+    sigact.sa_flags = SA_SIGINFO;
+    sigact.sa_sigaction = sighandler;
+
+    int sig;
+    for (sig = 1; sig <= 31; ++sig) {
+        if (sig == SIGKILL || sig == SIGSTOP) {
+            continue;
+        }
+        if (-1 == sigaction(sig, &sigact, NULL)) {
+            perror("sigaction");
+        }
+    }
+
+    sigset_t allset;
+    sigfillset(&allset);
+    if (-1 == sigprocmask(SIG_UNBLOCK, &allset, NULL)) {
+        perror(MSGPREFIX "sigprocmask");
+    }
+}
+
+// Terminates this process with sig, or returns 128+sig if it is ignored
+static int exit_signaled(int sig) {
+    signal(sig, SIG_DFL);
+    raise(sig);
+    // Signal was ignored, return 128+n as bash does
+    // see https://linux.die.net/man/1/bash
+    return 128+sig;
+}
+
+// Waits for pid and returns its exit code, or dies of its signal. As the
+// init of a pid namespace, also reaps the orphans reparented to it, and
+// passes the signal to the proxy, as init ignores the signal it raises.
+static int exit_like(pid_t pid) {
+    pid_t wait_for = getpid() == 1 ? -1 : pid;
+    int status;
+    int ret;
+    do {
+        ret = waitpid(wait_for, &status, 0);
+    } while ((ret == -1 && errno == EINTR) || (0 < ret && ret != pid));
+
+    if (ret == -1) {
+        perror(MSGPREFIX "waitpid");
+        return 1;
+    }
+
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+
+    if (WIFSIGNALED(status)) {
+        // Try to terminate the current process with the same signal
+        // as the child process was terminated
+        const int sig = WTERMSIG(status);
+        const char *sigfile = getpid() == 1 ? getenv(PIDNS_SIGNAL_ENV) : NULL;
+        int fd = sigfile ? open(sigfile, O_WRONLY | O_TRUNC | O_CLOEXEC) : -1;
+        if (0 <= fd) {
+            dprintf(fd, "%d\n", sig);
+            close(fd);
+        }
+        return exit_signaled(sig);
+    }
+
+    return 1;
+}
+
+static bool pid_in_use(uint64_t pid) {
+    char path[32];
+    struct stat st;
+    snprintf(path, sizeof(path), "/proc/%llu", (unsigned long long)pid);
+    if (stat(path, &st)) {
+        return false;
+    }
+    fprintf(stderr, "Pid %llu of the image is taken, restoring in a new pid namespace\n", (unsigned long long)pid);
+    return true;
+}
+
+// True if a pid or tid of the image is in use here, so that CRIU cannot
+// restore it in this pid namespace
+static bool pids_taken(const char *imagedir) {
+    struct pb img, entry, sub;
+    unsigned char *buf = read_image(imagedir, "pstree.img", PSTREE_MAGIC, &img);
+    if (!buf) {
+        return true;
+    }
+    bool taken = false;
+    while (!taken && pb_record(&img, &entry)) {
+        uint32_t field;
+        uint64_t value;
+        for (sub.p = NULL; !taken && pb_next(&entry, &field, &value, &sub); sub.p = NULL) {
+            if (field != 1 && field != 5) { // PstreeEntry.pid and threads
+                continue;
+            }
+            if (!sub.p) {
+                taken = pid_in_use(value);
+            }
+            while (!taken && sub.p && sub.p < sub.end && pb_varint(&sub, &value)) { // packed threads
+                taken = pid_in_use(value);
+            }
+        }
+    }
+    free(buf);
+    return taken;
+}
+
+// Continues the restore in a new pid namespace if PIDNS_ENV asks for it.
+// This process stays outside as a proxy: it passes signals on to its child,
+// which becomes CRIU and then restorewait as the init of the namespace, and
+// exits like it. Returns in the child, or if no namespace is used.
+static void restore_pidns(const char *imagedir) {
+    const char *mode = getenv(PIDNS_ENV);
+    if (!mode || (strcmp(mode, "always") && strcmp(mode, "auto"))) {
+        if (mode) {
+            fprintf(stderr, "Invalid %s=%s, expected 'always' or 'auto'\n", PIDNS_ENV, mode);
+        }
+        return;
+    }
+    if (!strcmp(mode, "auto") && !pids_taken(imagedir)) {
+        return;
+    }
+    if (unshare(CLONE_NEWPID)) {
+        fprintf(stderr, "Cannot create pid namespace, restoring without it: %s\n", strerror(errno));
+        return;
+    }
+    char *sigfile = NULL;
+    const char *tmpdir = getenv("TMPDIR");
+    int sigfd = asprintf(&sigfile, "%s/crac-pidns-XXXXXX", tmpdir ? tmpdir : "/tmp") < 0
+        ? -1 : mkostemp(sigfile, O_CLOEXEC);
+    if (sigfd < 0) {
+        fprintf(stderr, "Cannot pass the signal of the JVM out of the pid namespace: %s\n", strerror(errno));
+    }
+    fflush(stderr);
+    pid_t child = fork();
+    if (child < 0) {
+        perror("fork");
+        return;
+    }
+    if (child) {
+        forward_signals(child);
+        int ret = exit_like(child);
+        char buf[16] = "";
+        if (0 <= sigfd) {
+            ssize_t n = pread(sigfd, buf, sizeof(buf) - 1, 0);
+            buf[n > 0 ? n : 0] = '\0';
+            unlink(sigfile);
+        }
+        exit(atoi(buf) > 0 ? exit_signaled(atoi(buf)) : ret);
+    }
+    if (0 <= sigfd) {
+        close(sigfd);
+        setenv(PIDNS_SIGNAL_ENV, sigfile, 1);
+    }
+
+    // A /proc of the new namespace, so that the pids CRIU and the JVM see
+    // there are their own. Mounts of the host still propagate in.
+    if (unshare(CLONE_NEWNS) || mount(NULL, "/", NULL, MS_SLAVE | MS_REC, NULL)
+            || mount("proc", "/proc", "proc", MS_NOSUID | MS_NODEV | MS_NOEXEC, NULL)) {
+        fprintf(stderr, "Cannot mount /proc of the pid namespace: %s\n", strerror(errno));
+    }
+    setenv(PIDNS_USED_ENV, mode, 1);
+}
+
 static int restore(const char *basedir,
         const char *self,
         const char *criu,
         const char *imagedir) {
+    char startstr[32];
+    snprintf(startstr, sizeof(startstr), "%lld", realtime_ns());
+    setenv(RESTORE_START_ENV, startstr, 1);
+
+    imagedir = restore_variant(imagedir);
+    const char *criu_imagedir = imagedir;
+    struct stat st;
+    bool encrypted = !stat(join_path(imagedir, ENCRYPTED_NAME), &st);
+    bool lazy_encrypted = false;
+    long long decrypt_ns = 0;
+    if (encrypted) {
+        long long start = realtime_ns();
+        if (!(criu_imagedir = decrypt_images(imagedir))) {
+            return 1;
+        }
+        // The injector decrypts the lazy pages straight into the processes,
+        // if it can, rather than CRIU reading another plain copy
+        lazy_encrypted = injection_threads(true) > 0 && lazy_pages_injectable(criu_imagedir);
+        if (decrypt_pages(imagedir, criu_imagedir, lazy_encrypted)) {
+            return 1;
+        }
+        decrypt_ns = realtime_ns() - start;
+    }
+
     const char* args[32] = {
         criu,
         "restore",
         "-W", ".",
         "--shell-job",
         "--action-script", self,
-        "-D", imagedir,
+        "-D", criu_imagedir,
     };
     const char** arg = args + 9;
 
+    if (start_injection(criu_imagedir, lazy_encrypted ? imagedir : NULL)) {
+        *arg++ = "--lazy-pages";
+    } else if (lazy_encrypted) {
+        // CRIU would restore the lazy pages left out as zeroes
+        long long start = realtime_ns();
+        if (decrypt_pages(imagedir, criu_imagedir, false)) {
+            return 1;
+        }
+        decrypt_ns += realtime_ns() - start;
+    }
+    if (encrypted) {
+        char nsstr[32];
+        snprintf(nsstr, sizeof(nsstr), "%lld", decrypt_ns);
+        setenv(DECRYPT_TIME_ENV, nsstr, 1);
+    }
     *arg++ = verbosity != NULL ? verbosity : "-v1";
     if (log_file != NULL) {
         *arg++ = "-o";
@@ -255,6 +3842,12 @@ static int restore(const char *basedir,
 
     memcpy(arg, tail, sizeof(tail));
 
+    setenv(RESTORE_IMAGEDIR_ENV, path_abs(imagedir), 1);
+    start_verification(imagedir);
+    setup_timens(imagedir);
+    // Last, as the helpers started above are to stay outside
+    restore_pidns(criu_imagedir);
+
     fflush(stderr);
 
     execv(criu, (char**)args);
@@ -264,8 +3857,6 @@ static int restore(const char *basedir,
     return 1;
 }
 
-#define MSGPREFIX ""
-
 static int post_resume(void) {
     char *pidstr = getenv("CRTOOLS_INIT_PID");
     if (!pidstr) {
@@ -274,14 +3865,60 @@ static int post_resume(void) {
     }
     int pid = atoi(pidstr);
 
-    char *strid = getenv("CRAC_NEW_ARGS_ID");
-    return kickjvm(pid, strid ? atoi(strid) : 0);
-}
+    // Before the decrypted image the injector reads from goes
+    char inject_stats[128] = "";
+    bool injected = finish_injection(inject_stats, sizeof(inject_stats));
 
-static void sighandler(int sig, siginfo_t *info, void *uc) {
-    if (0 <= g_pid) {
-        kill(g_pid, sig);
+    const char *decrypted = getenv(DECRYPTED_ENV);
+    if (decrypted) {
+        remove_dir(decrypted);
     }
+
+    long long verify_wait;
+    bool verified = finish_verification(&verify_wait);
+
+    char *startstr = getenv(RESTORE_START_ENV);
+    if (startstr) {
+        const char *imagedir = getenv(RESTORE_IMAGEDIR_ENV);
+        const char *decrypt_ns = getenv(DECRYPT_TIME_ENV);
+        const char *pidns = getenv(PIDNS_USED_ENV);
+        // The restore modes used, joined by '+', for predict to fit per mode
+        const char *modes[] = {
+            decrypted ? "encrypted" : NULL, getenv(VERIFY_STATUS_ENV) ? "verify" : NULL,
+            getenv(UFFD_STATUS_ENV) ? "eager" : NULL, getenv(TIMENS_USED_ENV) ? "timens" : NULL,
+            pidns ? "pidns" : NULL,
+        };
+        char mode[64] = "";
+        for (size_t i = 0; i < ARRAY_SIZE(modes); ++i) {
+            if (modes[i]) {
+                snprintf(mode + strlen(mode), sizeof(mode) - strlen(mode), "%s%s", mode[0] ? "+" : "", modes[i]);
+            }
+        }
+        char id[64] = "none";
+        if (imagedir) {
+            image_id(imagedir, id, sizeof(id));
+        }
+        metrics_record("op=restore result=%s class=%s mode=%s image=%s duration_ns=%lld image_bytes=%lld verify_wait_ns=%lld decrypt_ns=%s pidns=%s%s",
+                verified && injected ? "ok" : "fail", !verified ? "verify" : !injected ? "inject" : "none",
+                mode[0] ? mode : "restore", id, realtime_ns() - atoll(startstr), imagedir ? dir_size(imagedir) : 0,
+                verify_wait, decrypt_ns ? decrypt_ns : "0", pidns ? pidns : "none", inject_stats);
+    }
+
+    if (!verified) {
+        // The JVM is restored from corrupted memory, don't let it run
+        fprintf(stderr, MSGPREFIX "image verification failed, terminating restored JVM\n");
+        kill(pid, SIGKILL);
+        return 1;
+    }
+    if (!injected) {
+        // Some of the JVM's memory is missing
+        fprintf(stderr, MSGPREFIX "page injection failed, terminating restored JVM\n");
+        kill(pid, SIGKILL);
+        return 1;
+    }
+
+    char *strid = getenv("CRAC_NEW_ARGS_ID");
+    return kickjvm(pid, strid ? atoi(strid) : 0);
 }
 
 static int restorewait(void) {
@@ -289,55 +3926,225 @@ static int restorewait(void) {
     if (!pidstr) {
         fprintf(stderr, MSGPREFIX "no CRTOOLS_INIT_PID: signals may not be delivered\n");
     }
-    g_pid = pidstr ? atoi(pidstr) : -1;
+    forward_signals(pidstr ? atoi(pidstr) : -1);
 
-    struct sigaction sigact;
-    sigfillset(&sigact.sa_mask);
-    sigact.sa_flags = SA_SIGINFO;
-    sigact.sa_sigaction = sighandler;
+    measure_timer_burst(g_pid);
 
-    int sig;
-    for (sig = 1; sig <= 31; ++sig) {
-        if (sig == SIGKILL || sig == SIGSTOP) {
-            continue;
-        }
-        if (-1 == sigaction(sig, &sigact, NULL)) {
-            perror("sigaction");
+    // This process was CRIU before it exec'ed restorewait, and the peak
+    // RSS survives exec
+    struct rusage usage;
+    if (!getrusage(RUSAGE_SELF, &usage)) {
+        metrics_record("op=restorerss result=ok class=none criu_maxrss_kb=%ld", usage.ru_maxrss);
+    }
+
+    return exit_like(g_pid);
+}
+
+#define MAX_BUCKETS 16
+
+struct histogram {
+    const char *name;
+    const char *help;
+    const double *bounds;
+    size_t nbounds;
+    unsigned long long buckets[MAX_BUCKETS];
+    unsigned long long count;
+    double sum;
+};
+
+static void histogram_add(struct histogram *h, double value) {
+    for (size_t i = 0; i < h->nbounds; ++i) {
+        if (value <= h->bounds[i]) {
+            ++h->buckets[i];
         }
     }
+    ++h->count;
+    h->sum += value;
+}
 
-    sigset_t allset;
-    sigfillset(&allset);
-    if (-1 == sigprocmask(SIG_UNBLOCK, &allset, NULL)) {
-        perror(MSGPREFIX "sigprocmask");
+static void histogram_print(FILE *out, const struct histogram *h) {
+    fprintf(out, "# HELP %s %s\n", h->name, h->help);
+    fprintf(out, "# TYPE %s histogram\n", h->name);
+    for (size_t i = 0; i < h->nbounds; ++i) {
+        fprintf(out, "%s_bucket{le=\"%.10g\"} %llu\n", h->name, h->bounds[i], h->buckets[i]);
     }
+    fprintf(out, "%s_bucket{le=\"+Inf\"} %llu\n", h->name, h->count);
+    fprintf(out, "%s_sum %.10g\n", h->name, h->sum);
+    fprintf(out, "%s_count %llu\n", h->name, h->count);
+}
 
-    int status;
-    int ret;
-    do {
-        ret = waitpid(g_pid, &status, 0);
-    } while (ret == -1 && errno == EINTR);
+struct failure_count {
+    char op[32];
+    char class[32];
+    unsigned long long count;
+};
 
-    if (ret == -1) {
-        perror(MSGPREFIX "waitpid");
+// Aggregates the metrics sink into Prometheus text exposition format
+static void metrics_render(FILE *out, const char *path) {
+    static const double seconds[] = { 0.01, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30 };
+    static const double bytes[] = { 16 << 20, 64 << 20, 256 << 20, 1LL << 30, 4LL << 30, 16LL << 30, 64LL << 30 };
+    struct histogram pause = { .name = "crac_checkpoint_pause_seconds",
+        .help = "Time the engine held the JVM for checkpoint",
+        .bounds = seconds, .nbounds = ARRAY_SIZE(seconds) };
+    struct histogram restore = { .name = "crac_restore_latency_seconds",
+        .help = "Time from engine restore to JVM resume",
+        .bounds = seconds, .nbounds = ARRAY_SIZE(seconds) };
+    struct histogram size = { .name = "crac_image_size_bytes",
+        .help = "Size of checkpoint images",
+        .bounds = bytes, .nbounds = ARRAY_SIZE(bytes) };
+    struct histogram freeze = { .name = "crac_checkpoint_frozen_seconds",
+        .help = "Time CRIU kept the JVM frozen during dump",
+        .bounds = seconds, .nbounds = ARRAY_SIZE(seconds) };
+    struct histogram burst = { .name = "crac_restore_timer_burst_cpu_seconds",
+        .help = "CPU time used by the JVM in the window right after restore",
+        .bounds = seconds, .nbounds = ARRAY_SIZE(seconds) };
+    struct failure_count failures[32];
+    size_t nfailures = 0;
+    unsigned long long records = 0;
+
+    FILE *in = fopen(path, "r");
+    if (in) {
+        char line[1024];
+        while (fgets(line, sizeof(line), in)) {
+            char op[32] = "", result[32] = "", class[32] = "";
+            long long duration = 0, image = 0, cpu = 0, frozen = -1;
+            char *save;
+            for (char *tok = strtok_r(line, " \n", &save); tok; tok = strtok_r(NULL, " \n", &save)) {
+                sscanf(tok, "op=%31s", op);
+                sscanf(tok, "result=%31s", result);
+                sscanf(tok, "class=%31s", class);
+                sscanf(tok, "duration_ns=%lld", &duration);
+                sscanf(tok, "image_bytes=%lld", &image);
+                sscanf(tok, "cpu_ns=%lld", &cpu);
+                sscanf(tok, "frozen_ns=%lld", &frozen);
+            }
+            ++records;
+            if (!strcmp(result, "fail")) {
+                size_t i;
+                for (i = 0; i < nfailures; ++i) {
+                    if (!strcmp(failures[i].op, op) && !strcmp(failures[i].class, class)) {
+                        break;
+                    }
+                }
+                if (i == nfailures && nfailures < ARRAY_SIZE(failures)) {
+                    strcpy(failures[i].op, op);
+                    strcpy(failures[i].class, class);
+                    failures[i].count = 0;
+                    ++nfailures;
+                }
+                if (i < nfailures) {
+                    ++failures[i].count;
+                }
+                continue;
+            }
+            if (!strcmp(op, "checkpoint")) {
+                histogram_add(&pause, duration / 1e9);
+                histogram_add(&size, image);
+                if (frozen >= 0) {
+                    histogram_add(&freeze, frozen / 1e9);
+                }
+            } else if (!strcmp(op, "restore")) {
+                histogram_add(&restore, duration / 1e9);
+            } else if (!strcmp(op, "timerburst")) {
+                histogram_add(&burst, cpu / 1e9);
+            }
+        }
+        fclose(in);
+    }
+
+    histogram_print(out, &pause);
+    histogram_print(out, &freeze);
+    histogram_print(out, &restore);
+    histogram_print(out, &size);
+    histogram_print(out, &burst);
+    fprintf(out, "# HELP crac_engine_failures_total Failed engine operations by failure class\n");
+    fprintf(out, "# TYPE crac_engine_failures_total counter\n");
+    for (size_t i = 0; i < nfailures; ++i) {
+        fprintf(out, "crac_engine_failures_total{op=\"%s\",class=\"%s\"} %llu\n",
+                failures[i].op, failures[i].class, failures[i].count);
+    }
+    fprintf(out, "# HELP crac_engine_records_total Records in the metrics sink\n");
+    fprintf(out, "# TYPE crac_engine_records_total counter\n");
+    fprintf(out, "crac_engine_records_total %llu\n", records);
+}
+
+// Serves the metrics sink over HTTP on a unix socket, e.g. for
+// curl --unix-socket <path> http://localhost/metrics
+static int metrics_serve(const char *sockpath) {
+    const char *path = getenv(METRICS_ENV);
+    if (!path) {
+        fprintf(stderr, MSGPREFIX "no " METRICS_ENV " to serve\n");
+        return 1;
+    }
+    if (!sockpath) {
+        fprintf(stderr, MSGPREFIX "socket path is not specified\n");
         return 1;
     }
 
-    if (WIFEXITED(status)) {
-        return WEXITSTATUS(status);
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(sockpath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, MSGPREFIX "socket path is too long: %s\n", sockpath);
+        return 1;
     }
+    strcpy(addr.sun_path, sockpath);
 
-    if (WIFSIGNALED(status)) {
-        // Try to terminate the current process with the same signal
-        // as the child process was terminated
-        const int sig = WTERMSIG(status);
-        signal(sig, SIG_DFL);
-        raise(sig);
-        // Signal was ignored, return 128+n as bash does
-        // see https://linux.die.net/man/1/bash
-        return 128+sig;
+    int sk = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sk < 0) {
+        perror(MSGPREFIX "socket");
+        return 1;
+    }
+    unlink(sockpath);
+    if (bind(sk, (struct sockaddr *)&addr, sizeof(addr)) || listen(sk, 16)) {
+        perror(MSGPREFIX "bind");
+        close(sk);
+        return 1;
     }
+    signal(SIGPIPE, SIG_IGN);
+
+    for (;;) {
+        int client = accept(sk, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror(MSGPREFIX "accept");
+            break;
+        }
+        // A client that neither sends its request nor reads the response
+        // must not hold up the others
+        struct timeval timeout = { .tv_sec = 1 };
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        // The request itself is irrelevant, every path returns the metrics
+        char req[4096];
+        if (read(client, req, sizeof(req)) < 0) {
+            close(client);
+            continue;
+        }
+
+        char *body = NULL;
+        size_t bodylen = 0;
+        FILE *out = open_memstream(&body, &bodylen);
+        if (!out) {
+            perror(MSGPREFIX "open_memstream");
+            close(client);
+            continue;
+        }
+        metrics_render(out, path);
+        fclose(out);
 
+        char header[256];
+        int hlen = snprintf(header, sizeof(header),
+                "HTTP/1.0 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: %zu\r\n\r\n", bodylen);
+        if (write(client, header, hlen) != hlen || write(client, body, bodylen) != (ssize_t)bodylen) {
+            perror(MSGPREFIX "write");
+        }
+        free(body);
+        close(client);
+    }
+    close(sk);
     return 1;
 }
 
@@ -382,6 +4189,19 @@ int main(int argc, char *argv[]) {
 
         char* imagedir = parse_options(argc, argv);
 
+        // actions that do not need CRIU
+        if (!strcmp(action, "metrics")) {
+            return metrics_serve(imagedir);
+        } else if (!strcmp(action, "verify")) {
+            return verify(imagedir);
+        } else if (!strcmp(action, "optimize")) {
+            return optimize(imagedir);
+        } else if (!strcmp(action, "diff")) {
+            return diff(imagedir, optind + 1 < argc ? argv[optind + 1] : NULL);
+        } else if (!strcmp(action, "predict")) {
+            return predict(imagedir, optind + 1 < argc ? argv[optind + 1] : NULL);
+        }
+
         char *basedir = dirname(strdup(argv[0]));
 
         char *criu = getenv("CRAC_CRIU_PATH");
@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+ * CA 94089 USA or visit www.azul.com if you need additional information or
+ * have any questions.
+ */
+
+package com.sun.hotspot.tools.compiler;
+
+import java.io.BufferedReader;
+import java.io.FileReader;
+import java.io.IOException;
+import java.io.PrintStream;
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.Comparator;
+import java.util.HashMap;
+import java.util.HashSet;
+import java.util.List;
+import java.util.Map;
+import java.util.Set;
+import java.util.TreeMap;
+import java.util.regex.Matcher;
+import java.util.regex.Pattern;
+
+/**
+ * Compares compilation activity after a CRaC restore with a steady-state
+ * baseline. The input is a log written with
+ * {@code -XX:+UnlockDiagnosticVMOptions -XX:+LogCompilation} by a JVM that
+ * was checkpointed and restored, so it holds both the run before the
+ * checkpoint and the run after the restore.
+ *
+ * <p>The post-restore period is cut into windows and each is compared with
+ * the baseline: runtime deoptimizations (uncommon traps), nmethods made not
+ * entrant, compilations, recompilations of a method at a level it was
+ * already compiled at, and the time tasks waited in the compile queue.
+ *
+ * <p>Only the elements needed for that are looked at, by pattern rather
+ * than with the full log parser, so truncated logs of a killed JVM and the
+ * log of a restored JVM, which is not well-formed XML, can be read.
+ */
+public class RestoreReport {
+
+    private static final Pattern ELEMENT = Pattern.compile(
+        "<(uncommon_trap|make_not_entrant|task_queued|task)\\s([^>]*)>");
+    private static final Pattern ATTR = Pattern.compile("(\\w+)='([^']*)'");
+
+    /** Gaps shorter than this are not taken for a checkpoint. */
+    private static final double MIN_GAP = 1.0;
+
+    static class Event {
+        final String kind;
+        final double stamp;
+        final Map<String, String> attrs;
+
+        Event(String kind, double stamp, Map<String, String> attrs) {
+            this.kind = kind;
+            this.stamp = stamp;
+            this.attrs = attrs;
+        }
+    }
+
+    static class Window {
+        final String name;
+        final double from;
+        final double to;
+        int traps;
+        int notEntrant;
+        int compiles;
+        int recompiles;
+        final List<Double> queueMs = new ArrayList<>();
+        final Map<String, Integer> reasons = new TreeMap<>();
+
+        Window(String name, double from, double to) {
+            this.name = name;
+            this.from = from;
+            this.to = to;
+        }
+
+        boolean contains(double stamp) {
+            return stamp >= from && stamp < to;
+        }
+
+        double perMinute(int count) {
+            return to > from ? count * 60.0 / (to - from) : 0;
+        }
+    }
+
+    static List<Event> read(String file) throws IOException {
+        List<Event> events = new ArrayList<>();
+        try (BufferedReader in = new BufferedReader(new FileReader(file))) {
+            String line;
+            while ((line = in.readLine()) != null) {
+                Matcher m = ELEMENT.matcher(line);
+                while (m.find()) {
+                    Map<String, String> attrs = new HashMap<>();
+                    Matcher a = ATTR.matcher(m.group(2));
+                    while (a.find()) {
+                        attrs.put(a.group(1), a.group(2));
+                    }
+                    // Traps recorded while parsing a method carry no stamp,
+                    // only the ones hit at runtime do.
+                    String stamp = attrs.get("stamp");
+                    if (stamp == null) {
+                        continue;
+                    }
+                    try {
+                        events.add(new Event(m.group(1), Double.parseDouble(stamp), attrs));
+                    } catch (NumberFormatException e) {
+                        // a line cut short by a killed JVM
+                    }
+                }
+            }
+        }
+        // Compiler thread logs are appended at VM exit, out of time order
+        events.sort(Comparator.comparingDouble(e -> e.stamp));
+        return events;
+    }
+
+    /**
+     * The VM's time stamps keep running across the checkpoint, so the
+     * restore shows as the largest gap between consecutive events.
+     */
+    static double[] findRestore(List<Event> events) {
+        double gap = 0;
+        double at = Double.NaN;
+        for (int i = 1; i < events.size(); i++) {
+            double d = events.get(i).stamp - events.get(i - 1).stamp;
+            if (d > gap) {
+                gap = d;
+                at = events.get(i).stamp;
+            }
+        }
+        return new double[] { at, gap };
+    }
+
+    static void account(List<Event> events, List<Window> windows) {
+        Map<String, Double> queued = new HashMap<>();
+        Set<String> compiled = new HashSet<>();
+        for (Event e : events) {
+            String id = e.attrs.get("compile_id");
+            if (e.kind.equals("task_queued")) {
+                if (id != null) {
+                    queued.put(id, e.stamp);
+                }
+                continue;
+            }
+            boolean recompile = false;
+            if (e.kind.equals("task")) {
+                String key = e.attrs.get("method") + " " + e.attrs.get("level") + " " + e.attrs.get("osr_bci");
+                recompile = !compiled.add(key);
+            }
+            for (Window w : windows) {
+                if (!w.contains(e.stamp)) {
+                    continue;
+                }
+                switch (e.kind) {
+                    case "uncommon_trap":
+                        w.traps++;
+                        w.reasons.merge(e.attrs.getOrDefault("reason", "?") + "/"
+                                        + e.attrs.getOrDefault("action", "?"), 1, Integer::sum);
+                        break;
+                    case "make_not_entrant":
+                        w.notEntrant++;
+                        break;
+                    case "task":
+                        w.compiles++;
+                        if (recompile) {
+                            w.recompiles++;
+                        }
+                        Double q = id != null ? queued.get(id) : null;
+                        if (q != null) {
+                            w.queueMs.add((e.stamp - q) * 1000);
+                        }
+                        break;
+                }
+            }
+        }
+    }
+
+    static double percentile(List<Double> sorted, double p) {
+        if (sorted.isEmpty()) {
+            return 0;
+        }
+        int index = (int) Math.ceil(p * sorted.size()) - 1;
+        return sorted.get(Math.max(0, Math.min(sorted.size() - 1, index)));
+    }
+
+    static void print(PrintStream out, List<Window> windows) {
+        out.printf("%-14s %7s %10s %10s %10s %10s %9s %9s %9s %9s%n",
+                   "window", "secs", "traps/min", "nent/min", "comp/min", "recomp/min",
+                   "queue_avg", "queue_p50", "queue_p99", "queue_max");
+        for (Window w : windows) {
+            List<Double> q = new ArrayList<>(w.queueMs);
+            Collections.sort(q);
+            double avg = q.stream().mapToDouble(Double::doubleValue).average().orElse(0);
+            out.printf("%-14s %7.1f %10.1f %10.1f %10.1f %10.1f %9.2f %9.2f %9.2f %9.2f%n",
+                       w.name, w.to - w.from, w.perMinute(w.traps), w.perMinute(w.notEntrant),
+                       w.perMinute(w.compiles), w.perMinute(w.recompiles),
+                       avg, percentile(q, 0.5), percentile(q, 0.99), q.isEmpty() ? 0 : q.get(q.size() - 1));
+        }
+        out.println();
+        out.println("uncommon trap reasons (count):");
+        Set<String> reasons = new HashSet<>();
+        windows.forEach(w -> reasons.addAll(w.reasons.keySet()));
+        for (String r : reasons.stream().sorted().toList()) {
+            out.printf("  %-40s", r);
+            for (Window w : windows) {
+                out.printf(" %s=%d", w.name, w.reasons.getOrDefault(r, 0));
+            }
+            out.println();
+        }
+    }
+
+    static void usage() {
+        System.out.println("Usage: RestoreReport [-w seconds] [-n windows] [-r stamp] [-b from:to] log [baseline-log]");
+        System.out.println("  -w  length of a post-restore window in seconds (default 60)");
+        System.out.println("  -n  number of post-restore windows (default 3)");
+        System.out.println("  -r  time stamp of the restore, found from the checkpoint gap by default");
+        System.out.println("  -b  baseline interval, by default the window before the checkpoint,");
+        System.out.println("      or the last window of baseline-log if that is given");
+        System.exit(1);
+    }
+
+    public static void main(String[] args) throws IOException {
+        double width = 60;
+        int count = 3;
+        double restore = Double.NaN;
+        double[] baseline = null;
+        int i = 0;
+        try {
+            for (; i < args.length && args[i].startsWith("-"); i++) {
+                switch (args[i]) {
+                    case "-w": width = Double.parseDouble(args[++i]); break;
+                    case "-n": count = Integer.parseInt(args[++i]); break;
+                    case "-r": restore = Double.parseDouble(args[++i]); break;
+                    case "-b": {
+                        String[] b = args[++i].split(":");
+                        baseline = new double[] { Double.parseDouble(b[0]), Double.parseDouble(b[1]) };
+                        break;
+                    }
+                    default: usage();
+                }
+            }
+        } catch (ArrayIndexOutOfBoundsException | NumberFormatException e) {
+            usage();
+        }
+        if (i != args.length - 1 && i != args.length - 2) {
+            usage();
+        }
+
+        List<Event> events = read(args[i]);
+        if (events.isEmpty()) {
+            System.err.println("No compilation events in " + args[i]);
+            System.exit(1);
+        }
+        if (Double.isNaN(restore)) {
+            double[] found = findRestore(events);
+            if (!(found[1] >= MIN_GAP)) {
+                System.err.println("No checkpoint gap found in " + args[i] + ", give the restore stamp with -r");
+                System.exit(1);
+            }
+            restore = found[0];
+            System.out.printf("restore at %.3fs (no events for %.3fs before it)%n", restore, found[1]);
+        }
+        double checkpoint = restore;
+        for (Event e : events) {
+            if (e.stamp < restore) {
+                checkpoint = e.stamp;
+            }
+        }
+
+        List<Window> windows = new ArrayList<>();
+        List<Event> baseEvents = events;
+        if (i == args.length - 2) {
+            baseEvents = read(args[i + 1]);
+            if (baseline == null) {
+                double end = baseEvents.isEmpty() ? 0 : baseEvents.get(baseEvents.size() - 1).stamp;
+                baseline = new double[] { end - width, Math.nextUp(end) };
+            }
+        } else if (baseline == null) {
+            baseline = new double[] { checkpoint - width, Math.nextUp(checkpoint) };
+        }
+        Window base = new Window("baseline", Math.max(0, baseline[0]), baseline[1]);
+        for (int n = 0; n < count; n++) {
+            windows.add(new Window(String.format("restore+%.0fs", n * width),
+                                   restore + n * width, restore + (n + 1) * width));
+        }
+        account(events, windows);
+        account(baseEvents, List.of(base));
+        windows.add(0, base);
+        print(System.out, windows);
+    }
+}
@@ -0,0 +1,229 @@
+#!/bin/bash
+#
+# Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+# DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+#
+# This code is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 only, as
+# published by the Free Software Foundation.
+#
+# This code is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# version 2 for more details (a copy is included in the LICENSE file that
+# accompanied this code).
+#
+# You should have received a copy of the GNU General Public License version
+# 2 along with this work; if not, write to the Free Software Foundation,
+# Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+# Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+# CA 94089 USA or visit www.azul.com if you need additional information or
+# have any questions.
+#
+
+# Collects performance evidence from a slow or hung CRaC checkpoint or
+# restore, for the failure handler to attach to the test results.
+#
+# Usage: crac-evidence.sh [-o OUTDIR] [-s PROFILE_SECONDS] PID
+#        crac-evidence.sh [-o OUTDIR] -d DIR
+#
+# With a PID, the process and all of its descendants are looked at: the
+# test JVM, criuengine, CRIU and a restored JVM alike. Collected are
+#   - the engine timeline, from the file CRAC_ENGINE_METRICS of any of the
+#     processes names
+#   - per image directory (-XX:CRaCCheckpointTo / CRaCRestoreFrom on a
+#     command line): stats-dump and stats-restore, decoded with crit if
+#     installed, the tail of dump4.log and restore logs, and a listing
+#   - per process: status, stat, maps, smaps_rollup, limits, cgroup, open
+#     fds, wchan and kernel stack, and the state of every thread
+#   - a CPU profile of PROFILE_SECONDS (default: 5): perf if installed,
+#     otherwise per-thread CPU time sampled from /proc, plus jcmd
+#     Thread.print of the JVMs at the start and end
+# With -d, DIR (e.g. a jtreg scratch directory) is searched for image
+# directories and metrics files instead, for when the processes are gone.
+#
+# Everything goes to OUTDIR (default: crac-evidence-PID or
+# crac-evidence) with an index in OUTDIR/summary.txt.
+#
+# The script is installed next to the failure handler in the image's bin
+# directory, but nothing runs it yet: the failure handler's conf files are
+# not part of this tree. Hooking it in takes these entries in
+# conf/linux.properties:
+#   onTimeout=... crac.evidence
+#   crac.evidence.app=crac-evidence.sh
+#   crac.evidence.args=%p
+# Even then it only covers hung tests. The failure handler does not run for
+# a test that is slow but passes; for those, keep the scratch directory
+# (jtreg -retain) and run the script by hand with -d.
+
+out=
+seconds=5
+dir=
+while getopts "o:s:d:" opt; do
+    case $opt in
+        o) out=$OPTARG ;;
+        s) seconds=$OPTARG ;;
+        d) dir=$OPTARG ;;
+        *) echo "usage: crac-evidence.sh [-o OUTDIR] [-s PROFILE_SECONDS] PID | -d DIR" >&2; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+pid=$1
+if [ -z "$pid" ] && [ -z "$dir" ]; then
+    echo "usage: crac-evidence.sh [-o OUTDIR] [-s PROFILE_SECONDS] PID | -d DIR" >&2
+    exit 1
+fi
+out=${out:-crac-evidence${pid:+-$pid}}
+mkdir -p "$out"
+summary=$out/summary.txt
+: > "$summary"
+
+note() {
+    echo "$*" | tee -a "$summary"
+}
+
+# The process and its descendants, parents first
+tree() {
+    echo "$1"
+    local child
+    for child in $(cat /proc/"$1"/task/*/children 2>/dev/null); do
+        tree "$child"
+    done
+}
+
+cmdline() {
+    tr '\0\n' '  ' < "/proc/$1/cmdline" 2>/dev/null
+}
+
+# Image directories and metrics files referred to by the processes
+image_dirs() {
+    local p
+    for p in "$@"; do
+        tr '\0' '\n' < "/proc/$p/cmdline" 2>/dev/null \
+            | sed -n 's/^-XX:CRaCCheckpointTo=//p;s/^-XX:CRaCRestoreFrom=//p' \
+            | while read -r d; do
+                case $d in
+                    /*) echo "$d" ;;
+                    *) echo "$(readlink "/proc/$p/cwd")/$d" ;;
+                esac
+            done
+        # criuengine and CRIU take it as -D or in the environment
+        tr '\0' '\n' < "/proc/$p/cmdline" 2>/dev/null | sed -n '/^-D$/{n;p}' \
+            | sed "s|^\([^/]\)|$(readlink "/proc/$p/cwd")/\1|"
+        tr '\0' '\n' < "/proc/$p/environ" 2>/dev/null | sed -n 's/^CRAC_RESTORE_IMAGEDIR=//p'
+    done | sort -u
+}
+
+metrics_files() {
+    local p
+    for p in "$@"; do
+        tr '\0' '\n' < "/proc/$p/environ" 2>/dev/null | sed -n 's/^CRAC_ENGINE_METRICS=//p'
+    done | sort -u
+}
+
+collect_image() {
+    local d=$1 name
+    [ -d "$d" ] || return
+    name=image-$(echo "$d" | tr '/' '_')
+    mkdir -p "$out/$name"
+    note "image $d -> $name"
+    ls -la "$d" > "$out/$name/listing.txt" 2>&1
+    local f
+    for f in stats-dump stats-restore; do
+        [ -f "$d/$f" ] || continue
+        cp "$d/$f" "$out/$name/"
+        command -v crit > /dev/null && crit show "$d/$f" > "$out/$name/$f.txt" 2>&1
+    done
+    for f in "$d"/*.log; do
+        [ -f "$f" ] && tail -n 300 "$f" > "$out/$name/$(basename "$f").tail"
+    done
+    # Engine side files: checksums manifest, clocks, encryption marker
+    for f in crac-checksums crac-clocks crac-encrypted; do
+        [ -f "$d/$f" ] && cp "$d/$f" "$out/$name/"
+    done
+}
+
+collect_metrics() {
+    local m=$1
+    [ -f "$m" ] || return
+    note "engine metrics $m"
+    tail -n 500 "$m" > "$out/engine-metrics-$(basename "$m").txt"
+}
+
+collect_process() {
+    local p=$1 d=$out/proc-$1 f
+    mkdir -p "$d"
+    note "process $p: $(cmdline "$p" | cut -c1-200)"
+    for f in status stat maps smaps_rollup limits cgroup wchan stack sched io; do
+        cat "/proc/$p/$f" > "$d/$f" 2>/dev/null
+    done
+    ls -l "/proc/$p/fd" > "$d/fds" 2>&1
+    local t
+    for t in /proc/"$p"/task/*; do
+        echo "$(basename "$t") $(cat "$t/comm" 2>/dev/null) $(cat "$t/wchan" 2>/dev/null) $(cut -d' ' -f3,14,15 "$t/stat" 2>/dev/null)"
+    done > "$d/threads"
+}
+
+# Per-thread CPU time over the profile window: "PID TID COMM CPU_MS"
+sample_threads() {
+    local p t
+    for p in "$@"; do
+        for t in /proc/"$p"/task/*; do
+            awk -v p="$p" -v t="$(basename "$t")" '{ sub(/.*\) /, ""); print p, t, $12 + $13 }' "$t/stat" 2>/dev/null
+        done
+    done
+}
+
+profile() {
+    local pids=("$@")
+    note "profile of ${seconds}s"
+    local java
+    for java in "${pids[@]}"; do
+        cmdline "$java" | grep -q java && command -v jcmd > /dev/null \
+            && timeout 10 jcmd "$java" Thread.print > "$out/threads-$java-start.txt" 2>&1
+    done
+    if command -v perf > /dev/null && timeout $((seconds + 10)) perf record -q -F 99 -g \
+            -p "$(IFS=,; echo "${pids[*]}")" -o "$out/perf.data" -- sleep "$seconds" > /dev/null 2>&1; then
+        perf report -i "$out/perf.data" --stdio --no-children > "$out/perf-report.txt" 2>/dev/null
+        note "perf profile in perf-report.txt"
+    else
+        sample_threads "${pids[@]}" > "$out/cpu-0.txt"
+        sleep "$seconds"
+        sample_threads "${pids[@]}" > "$out/cpu-1.txt"
+        local hz
+        hz=$(getconf CLK_TCK)
+        join -j 1 <(awk '{ print $1 ":" $2, $3 }' "$out/cpu-0.txt" | sort) \
+                <(awk '{ print $1 ":" $2, $3 }' "$out/cpu-1.txt" | sort) \
+            | awk -v hz="$hz" '{ printf "%s %.1f\n", $1, ($3 - $2) * 1000 / hz }' | sort -k2,2gr \
+            > "$out/cpu-per-thread.txt"
+        note "CPU ms per pid:tid over the window in cpu-per-thread.txt"
+    fi
+    for java in "${pids[@]}"; do
+        cmdline "$java" | grep -q java && command -v jcmd > /dev/null \
+            && timeout 10 jcmd "$java" Thread.print > "$out/threads-$java-end.txt" 2>&1
+    done
+}
+
+if [ -n "$dir" ]; then
+    for d in $(find "$dir" \( -name stats-dump -o -name dump4.log -o -name inventory.img \) -printf '%h\n' | sort -u); do
+        collect_image "$d"
+    done
+    for m in $(grep -rl --include='*' -m1 '^ts=[0-9]* op=' "$dir" 2>/dev/null | head -20); do
+        collect_metrics "$m"
+    done
+else
+    [ -d "/proc/$pid" ] || { echo "no process $pid" >&2; exit 1; }
+    pids=($(tree "$pid"))
+    for p in "${pids[@]}"; do
+        collect_process "$p"
+    done
+    for d in $(image_dirs "${pids[@]}"); do
+        collect_image "$d"
+    done
+    for m in $(metrics_files "${pids[@]}"); do
+        collect_metrics "$m"
+    done
+    profile "${pids[@]}"
+fi
+note "evidence in $out"
@@ -0,0 +1,147 @@
+#!/bin/bash
+#
+# Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+# DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+#
+# This code is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 only, as
+# published by the Free Software Foundation.
+#
+# This code is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# version 2 for more details (a copy is included in the LICENSE file that
+# accompanied this code).
+#
+# You should have received a copy of the GNU General Public License version
+# 2 along with this work; if not, write to the Free Software Foundation,
+# Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+# Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+# CA 94089 USA or visit www.azul.com if you need additional information or
+# have any questions.
+#
+
+# How checkpoint and restore scale with the amount of compiled code.
+#
+# CompileTheWorld is run under a CRaC JDK until the code cache holds the
+# next fill level, then the JVM is checkpointed with jcmd JDK.checkpoint and
+# restored. Dump time, restore time and image size come from the engine's
+# CRAC_ENGINE_METRICS records; code cache and metaspace occupancy from jcmd
+# at the time of checkpoint. A fresh JVM is used for every level.
+#
+# Usage: crac-scaling.sh [-l "LEVELS_MB"] [-d WORKDIR] [TARGET...]
+#   LEVELS_MB   code cache occupancy levels (default: 8 16 32 64 96)
+#   TARGET      what to compile, as for ctw.sh, relative to dist/
+#               (default: modules:java.base)
+#
+# Writes WORKDIR/scaling.csv and, if gnuplot is available, scaling.png.
+# Run 'make' first to build dist/ctw.sh.
+
+cd "$(dirname "$0")"
+
+JAVA_HOME=${JAVA_HOME:-$(dirname "$(dirname "$(readlink -f "$(which java)")")")}
+JCMD=$JAVA_HOME/bin/jcmd
+export JAVA_HOME
+
+levels="8 16 32 64 96"
+work=crac.work
+while getopts "l:d:" opt; do
+    case $opt in
+        l) levels=$OPTARG ;;
+        d) work=$OPTARG ;;
+        *) echo "usage: crac-scaling.sh [-l LEVELS_MB] [-d WORKDIR] [TARGET...]" >&2; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+targets=${*:-modules:java.base}
+
+[ -x dist/ctw.sh ] || { echo "dist/ctw.sh not found, run make first" >&2; exit 1; }
+rm -rf "$work"
+mkdir -p "$work"
+work=$(cd "$work" && pwd)
+export CRAC_ENGINE_METRICS=$work/metrics
+
+# Sum of used=...Kb over all code heaps
+codecache_kb() {
+    "$JCMD" "$1" Compiler.codecache 2>/dev/null \
+        | sed -n 's/.* used=\([0-9]*\)Kb.*/\1/p' | awk '{ s += $1 } END { print s + 0 }'
+}
+
+metaspace_kb() {
+    "$JCMD" "$1" GC.heap_info 2>/dev/null | sed -n 's/^ *Metaspace *used \([0-9]*\)K.*/\1/p'
+}
+
+# Field of the last successful record of an operation in the metrics
+metric() {
+    awk -v op="op=$1" -v f="$2=" '$0 ~ op && / result=ok / {
+        for (i = 1; i <= NF; ++i) if (index($i, f) == 1) v = substr($i, length(f) + 1) } END { print v }' \
+        "$CRAC_ENGINE_METRICS" 2>/dev/null
+}
+
+echo "level_mb,codecache_kb,metaspace_kb,dump_ms,restore_ms,image_mb" > "$work/scaling.csv"
+for level in $levels; do
+    image=$work/image-$level
+    JAVA_OPTIONS="-XX:CRaCCheckpointTo=$image -XX:ReservedCodeCacheSize=256m" \
+        sh -c 'cd dist && exec sh ./ctw.sh "$@"' ctw $targets > "$work/ctw-$level.log" 2>&1 &
+    launcher=$!
+    pid=
+    used=0
+    while kill -0 "$launcher" 2>/dev/null; do
+        pid=${pid:-$(pgrep -P "$launcher" java)}
+        if [ -n "$pid" ]; then
+            used=$(codecache_kb "$pid")
+            [ "$used" -ge $((level * 1024)) ] && break
+        fi
+        sleep 0.2
+    done
+    if ! kill -0 "$launcher" 2>/dev/null; then
+        echo "CompileTheWorld finished before reaching $level MB (at ${used} KB), use a bigger TARGET" >&2
+        break
+    fi
+
+    meta=$(metaspace_kb "$pid")
+    "$JCMD" "$pid" JDK.checkpoint > "$work/checkpoint-$level.log" 2>&1
+    wait "$launcher"
+    if [ ! -f "$image/inventory.img" ]; then
+        echo "checkpoint at $level MB failed, see $work/ctw-$level.log" >&2
+        break
+    fi
+    dump_ns=$(metric checkpoint duration_ns)
+    image_bytes=$(metric checkpoint image_bytes)
+
+    restores=$(grep -c "op=restore " "$CRAC_ENGINE_METRICS" 2>/dev/null)
+    "$JAVA_HOME/bin/java" -XX:CRaCRestoreFrom="$image" > "$work/restore-$level.log" 2>&1 &
+    restored=$!
+    for i in $(seq 1 600); do
+        [ "$(grep -c "op=restore " "$CRAC_ENGINE_METRICS" 2>/dev/null)" -gt "${restores:-0}" ] && break
+        kill -0 "$restored" 2>/dev/null || break
+        sleep 0.1
+    done
+    kill "$restored" 2>/dev/null
+    wait "$restored" 2>/dev/null
+    restore_ns=$(metric restore duration_ns)
+
+    awk -v l="$level" -v c="$used" -v m="${meta:-NA}" -v d="$dump_ns" -v r="$restore_ns" -v b="$image_bytes" \
+        'BEGIN { printf "%s,%s,%s,%.1f,%.1f,%.1f\n", l, c, m, d / 1e6, r / 1e6, b / 1048576 }' \
+        >> "$work/scaling.csv"
+    tail -1 "$work/scaling.csv"
+    rm -rf "$image"
+done
+
+if command -v gnuplot > /dev/null; then
+    gnuplot <<GP
+set terminal png size 1000,700
+set output "$work/scaling.png"
+set datafile separator ","
+set key top left
+set xlabel "code cache used (MB)"
+set ylabel "time (ms)"
+set y2label "image size (MB)"
+set y2tics
+plot "$work/scaling.csv" using (\$2/1024):4 with linespoints title "dump", \
+     "" using (\$2/1024):5 with linespoints title "restore", \
+     "" using (\$2/1024):6 axes x1y2 with linespoints title "image"
+GP
+fi
+cat "$work/scaling.csv"
@@ -0,0 +1,190 @@
+#!/bin/bash
+#
+# Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+# DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+#
+# This code is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 only, as
+# published by the Free Software Foundation.
+#
+# This code is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# version 2 for more details (a copy is included in the LICENSE file that
+# accompanied this code).
+#
+# You should have received a copy of the GNU General Public License version
+# 2 along with this work; if not, write to the Free Software Foundation,
+# Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+# Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+# CA 94089 USA or visit www.azul.com if you need additional information or
+# have any questions.
+#
+
+# Searches generated programs for shapes that make checkpoint or restore
+# slow.
+#
+# Every test generated by 'make install' is run once without a checkpoint,
+# for its output and the run time of its main, and then a number of times
+# under jdk.test.lib.jittester.crac.CheckpointAt, which checkpoints it at a
+# random point within that run time. Both are measured by CheckpointAt
+# from the call of main, so JVM startup does not count and the checkpoint
+# does not come after the test has completed. Each image is restored and the
+# output of the checkpointed and restored run is compared with the plain
+# one.
+#
+# Usage: crac-search.sh [-r RUNS] [-n TESTS] [-k K] [-d WORKDIR]
+#   RUNS   random checkpoints per test (default: 3)
+#   TESTS  stop after this many tests (default: all)
+#   K      a run is an outlier if a metric is above median + K * MAD
+#          (default: 5)
+#
+# Writes WORKDIR/search.csv with dump and restore time from the engine
+# metrics, image size and the number of threads (core-*.img) per run.
+# Outliers are listed in WORKDIR/outliers.csv, and for each one the test,
+# the delay and a repro.sh to run it again are kept in
+# WORKDIR/reproducers. Run 'make' and 'make install' first; TESTBASE_DIR
+# is where the latter put the tests.
+
+cd "$(dirname "$0")"
+
+JAVA_HOME=${JAVA_HOME:-$(dirname "$(dirname "$(readlink -f "$(which java)")")")}
+JAVA=$JAVA_HOME/bin/java
+JAVAC=$JAVA_HOME/bin/javac
+TESTBASE_DIR=${TESTBASE_DIR:-ws/hotspot/test}
+JAR=$PWD/dist/JITtester.jar
+
+runs=3
+limit=
+k=5
+work=crac.work
+while getopts "r:n:k:d:" opt; do
+    case $opt in
+        r) runs=$OPTARG ;;
+        n) limit=$OPTARG ;;
+        k) k=$OPTARG ;;
+        d) work=$OPTARG ;;
+        *) echo "usage: crac-search.sh [-r RUNS] [-n TESTS] [-k K] [-d WORKDIR]" >&2; exit 1 ;;
+    esac
+done
+
+[ -f "$JAR" ] || { echo "$JAR not found, run make first" >&2; exit 1; }
+[ -d "$TESTBASE_DIR" ] || { echo "$TESTBASE_DIR not found, run make install first" >&2; exit 1; }
+rm -rf "$work"
+mkdir -p "$work/classes" "$work/reproducers"
+work=$(cd "$work" && pwd)
+testbase=$(cd "$TESTBASE_DIR" && pwd)
+export CRAC_ENGINE_METRICS=$work/metrics
+
+metric() {
+    awk -v op="op=$1" -v f="$2=" '
+        { found = 0; for (i = 1; i <= NF; ++i) if ($i == op) found = 1 }
+        found { v = "NA"; for (i = 1; i <= NF; ++i) if (index($i, f) == 1) v = substr($i, length(f) + 1) }
+        END { print v == "" ? "NA" : v }' "$CRAC_ENGINE_METRICS" 2>/dev/null
+}
+
+records() {
+    grep -c " op=$1 " "$CRAC_ENGINE_METRICS" 2>/dev/null
+}
+
+# Java tests are compiled, bytecode tests come as classes
+tests() {
+    find "$testbase" -name 'Test_*.java' -path '*java_tests*' | sort
+    find "$testbase" -name 'Test_*.class' -path '*bytecode_tests*' | sort
+}
+
+echo "test,run,delay_ms,main_ms,result,dump_ms,restore_ms,image_mb,threads,output_match" > "$work/search.csv"
+count=0
+for file in $(tests); do
+    [ -n "$limit" ] && [ "$count" -ge "$limit" ] && break
+    count=$((count + 1))
+    main=$(basename "${file%.*}")
+    kind=$(basename "$(dirname "$file")")
+    if [ "${file##*.}" = java ]; then
+        cp=$work/classes/$kind-$main
+        mkdir -p "$cp"
+        "$JAVAC" -d "$cp" -cp "$testbase" -sourcepath "$(dirname "$file")" "$file" > "$work/$kind-$main.javac" 2>&1 \
+            || continue
+        cp=$cp:$testbase
+    else
+        cp=$(dirname "$file"):$testbase
+    fi
+
+    timeout 120 "$JAVA" -cp "$JAR:$cp" jdk.test.lib.jittester.crac.CheckpointAt -1 "$main" \
+        > "$work/plain.out" 2> "$work/plain.err"
+    main_ms=$(sed -n 's/^main_ms=//p' "$work/plain.err")
+    [ -n "$main_ms" ] || { echo "$kind/$main did not complete, skipped" >&2; continue; }
+
+    for run in $(seq 1 "$runs"); do
+        delay=$((RANDOM % (main_ms > 0 ? main_ms : 1)))
+        image=$work/image
+        rm -rf "$image" "$work/run.out"
+        mkdir -p "$image"
+        dumps=$(records checkpoint)
+        timeout 120 "$JAVA" -XX:CRaCCheckpointTo="$image" -cp "$JAR:$cp" jdk.test.lib.jittester.crac.CheckpointAt \
+            "$delay" "$main" > "$work/run.out" 2> "$work/run.err"
+        result=completed dump=NA restore=NA size=NA threads=NA match=NA
+        if grep -q "checkpoint=failed" "$work/run.err"; then
+            result=failed
+        elif [ "$(records checkpoint)" -gt "${dumps:-0}" ]; then
+            result=checkpointed
+            dump=$(metric checkpoint duration_ns)
+            size=$(metric checkpoint image_bytes)
+            threads=$(ls "$image" | grep -c '^core-[0-9]*\.img$')
+            restores=$(records restore)
+            # The restored JVM writes on to run.out where it left off
+            timeout 120 "$JAVA" -XX:CRaCRestoreFrom="$image" > "$work/restore.log" 2>&1
+            if [ "$(records restore)" -gt "${restores:-0}" ]; then
+                result=restored
+                restore=$(metric restore duration_ns)
+            fi
+        fi
+        if [ "$result" != failed ]; then
+            cmp -s "$work/plain.out" "$work/run.out" && match=yes || match=no
+        fi
+        awk -v t="$kind/$main" -v r="$run" -v dl="$delay" -v p="$main_ms" -v res="$result" \
+            -v d="$dump" -v rs="$restore" -v s="$size" -v th="$threads" -v m="$match" '
+            function ms(ns) { return ns == "NA" ? "NA" : sprintf("%.1f", ns / 1e6) }
+            BEGIN {
+                printf "%s,%s,%s,%s,%s,%s,%s,%s,%s,%s\n", t, r, dl, p, res, ms(d), ms(rs),
+                    (s == "NA" ? "NA" : sprintf("%.1f", s / 1048576)), th, m
+            }' >> "$work/search.csv"
+        tail -1 "$work/search.csv"
+
+        # Everything needed to run it again, in case it turns out an outlier
+        repro=$work/reproducers/$kind-$main-$run
+        mkdir -p "$repro"
+        cp "$file" "$repro/"
+        cat > "$repro/repro.sh" <<REPRO
+#!/bin/sh
+# $kind/$main checkpointed after $delay ms
+rm -rf image && mkdir image
+"$JAVA" -XX:CRaCCheckpointTo=image -cp "$JAR:$cp" jdk.test.lib.jittester.crac.CheckpointAt $delay $main
+"$JAVA" -XX:CRaCRestoreFrom=image
+REPRO
+        chmod +x "$repro/repro.sh"
+    done
+done
+rm -rf "$work/image"
+
+# Outliers by median and median absolute deviation of each metric
+echo "test,run,metric,value,median,mad" > "$work/outliers.csv"
+for col in 6:dump_ms 7:restore_ms 8:image_mb 9:threads; do
+    values=$(awk -F, -v c="${col%%:*}" 'NR > 1 && $c != "NA" { print $c }' "$work/search.csv" | sort -g)
+    [ -n "$values" ] || continue
+    median=$(echo "$values" | awk '{ v[NR] = $1 } END { print v[int((NR + 1) / 2)] }')
+    mad=$(echo "$values" | awk -v m="$median" '{ d = $1 - m; print d < 0 ? -d : d }' | sort -g \
+        | awk '{ v[NR] = $1 } END { print v[int((NR + 1) / 2)] }')
+    awk -F, -v c="${col%%:*}" -v name="${col#*:}" -v m="$median" -v mad="$mad" -v k="$k" '
+        NR > 1 && $c != "NA" && $c > m + k * (mad > 0 ? mad : m * 0.1) {
+            printf "%s,%s,%s,%s,%s,%s\n", $1, $2, name, $c, m, mad
+        }' "$work/search.csv" >> "$work/outliers.csv"
+done
+# Only outliers are worth keeping
+for repro in "$work"/reproducers/*; do
+    name=$(basename "$repro")
+    awk -F, -v n="$name" 'NR > 1 { t = $1; sub("/", "-", t); if (t "-" $2 == n) found = 1 } END { exit !found }' \
+        "$work/outliers.csv" || rm -rf "$repro"
+done
+cat "$work/outliers.csv"
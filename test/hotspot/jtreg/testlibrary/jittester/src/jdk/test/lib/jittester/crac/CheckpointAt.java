@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+ * CA 94089 USA or visit www.azul.com if you need additional information or
+ * have any questions.
+ */
+
+package jdk.test.lib.jittester.crac;
+
+import java.lang.reflect.InvocationTargetException;
+import java.util.Arrays;
+
+import jdk.crac.Core;
+
+/**
+ * Runs a generated test and checkpoints it from another thread after a
+ * delay, so the checkpoint lands wherever the test happens to be.
+ *
+ * Usage: CheckpointAt DELAY_MS MAIN_CLASS [ARGS...]
+ *
+ * The delay counts from the call of the test's main, as does the
+ * "main_ms=N" printed to stderr when main returns, so a plain run with a
+ * negative DELAY_MS, which takes no checkpoint, tells the range of delays
+ * that land within the test rather than in JVM startup.
+ *
+ * Prints "checkpoint=restored" or "checkpoint=failed:REASON" to stderr
+ * after the checkpoint. If the test completes first, no checkpoint is
+ * taken.
+ */
+public class CheckpointAt {
+
+    public static void main(String[] args) throws Throwable {
+        if (args.length < 2) {
+            throw new IllegalArgumentException("Usage: CheckpointAt DELAY_MS MAIN_CLASS [ARGS...]");
+        }
+        long delay = Long.parseLong(args[0]);
+        long start = System.nanoTime();
+        Thread checkpointer = new Thread(() -> {
+            try {
+                long left;
+                while ((left = start + delay * 1_000_000 - System.nanoTime()) > 0) {
+                    Thread.sleep(left / 1_000_000, (int) (left % 1_000_000));
+                }
+                Core.checkpointRestore();
+                System.err.println("checkpoint=restored");
+            } catch (InterruptedException e) {
+                // the test completed first
+            } catch (Exception e) {
+                System.err.println("checkpoint=failed:" + e);
+            }
+        }, "CheckpointAt");
+        checkpointer.setDaemon(true);
+        if (delay >= 0) {
+            checkpointer.start();
+        }
+
+        try {
+            Class.forName(args[1]).getMethod("main", String[].class)
+                 .invoke(null, (Object) Arrays.copyOfRange(args, 2, args.length));
+        } catch (InvocationTargetException e) {
+            throw e.getCause();
+        }
+        System.err.println("main_ms=" + (System.nanoTime() - start) / 1_000_000);
+    }
+}
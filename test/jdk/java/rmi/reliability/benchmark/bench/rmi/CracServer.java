@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+ * CA 94089 USA or visit www.azul.com if you need additional information or
+ * have any questions.
+ */
+
+package bench.rmi;
+
+import java.rmi.NoSuchObjectException;
+import java.rmi.registry.LocateRegistry;
+import java.rmi.registry.Registry;
+import java.rmi.server.UnicastRemoteObject;
+import java.util.concurrent.CountDownLatch;
+
+import jdk.crac.Context;
+import jdk.crac.Core;
+import jdk.crac.Resource;
+
+/**
+ * The benchmark server of Main's -server mode, for crac.sh. It can be
+ * checkpointed: the registry and the server object are unexported before
+ * checkpoint, which closes their listening sockets, and exported again
+ * after restore. Remote objects the benchmarks leave exported keep their
+ * socket open and make the checkpoint fail.
+ */
+public class CracServer implements Resource {
+
+    private Registry registry;
+    private BenchServerImpl impl;
+
+    private void export() throws Exception {
+        registry = LocateRegistry.createRegistry(Main.PORT);
+        impl = new BenchServerImpl();
+        registry.bind(Main.REGNAME, impl);
+    }
+
+    private void unexport() throws NoSuchObjectException {
+        UnicastRemoteObject.unexportObject(impl, true);
+        UnicastRemoteObject.unexportObject(registry, true);
+        impl = null;
+        registry = null;
+    }
+
+    @Override
+    public void beforeCheckpoint(Context<? extends Resource> context) throws Exception {
+        unexport();
+    }
+
+    @Override
+    public void afterRestore(Context<? extends Resource> context) throws Exception {
+        export();
+    }
+
+    public static void main(String[] args) throws Exception {
+        CracServer server = new CracServer();
+        server.export();
+        Core.getGlobalContext().register(server);
+        // RMI threads don't keep the JVM alive while nothing is exported
+        new CountDownLatch(1).await();
+    }
+}
@@ -0,0 +1,137 @@
+#!/bin/bash
+#
+# Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+# DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+#
+# This code is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 only, as
+# published by the Free Software Foundation.
+#
+# This code is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# version 2 for more details (a copy is included in the LICENSE file that
+# accompanied this code).
+#
+# You should have received a copy of the GNU General Public License version
+# 2 along with this work; if not, write to the Free Software Foundation,
+# Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+# Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+# CA 94089 USA or visit www.azul.com if you need additional information or
+# have any questions.
+#
+
+# CRaC mode for the RMI benchmarks: how much of the server's warm-up
+# survives a checkpoint/restore through the engine.
+#
+# The benchmark server (CracServer, Main's -server mode made checkpointable)
+# is started under a CRaC JDK and the client is run against it:
+#   cold        first client run against a freshly started server
+#   warm        last of WARM_RUNS client runs, the server's steady state
+#   restored_N  the first RESTORED_RUNS client runs after the warm server
+#               was checkpointed (jcmd JDK.checkpoint) and restored
+# Every client run is a new JVM, so client warm-up is the same in all of
+# them and the differences come from the server. The server unexports its
+# registry and server object before checkpoint, closing their sockets, and
+# exports them again after restore.
+#
+# The per-benchmark times are taken from the text reports and written to
+# crac.csv with "retained", the share of the cold-to-warm improvement the
+# restored server kept in its first run: 100 means restore preserved all of
+# the warm-up.
+#
+# Usage: crac.sh [-c CONFIG] [-w WARM_RUNS] [-r RESTORED_RUNS] [-d WORKDIR]
+# Classes are expected in ../.. (see the Makefile). If the checkpoint fails,
+# the server log in WORKDIR says why.
+
+cd "$(dirname "$0")"
+
+if [ -n "$JAVA_HOME" ]; then
+    JAVA=$JAVA_HOME/bin/java
+    JCMD=$JAVA_HOME/bin/jcmd
+else
+    JAVA=java
+    JCMD=jcmd
+fi
+CP=../..
+SERVER_WAIT=${SERVER_WAIT:-3}
+
+config=
+warm_runs=5
+restored_runs=3
+work=crac.work
+while getopts "c:w:r:d:" opt; do
+    case $opt in
+        c) config="-c $OPTARG" ;;
+        w) warm_runs=$OPTARG ;;
+        r) restored_runs=$OPTARG ;;
+        d) work=$OPTARG ;;
+        *) echo "usage: crac.sh [-c CONFIG] [-w WARM_RUNS] [-r RESTORED_RUNS] [-d WORKDIR]" >&2; exit 1 ;;
+    esac
+done
+
+rm -rf "$work"
+mkdir -p "$work"
+image=$(cd "$work" && pwd)/image
+
+client() {
+    "$JAVA" -cp $CP bench.rmi.Main $config -client localhost -o "$work/$1.txt" > "$work/$1.log" 2>&1 \
+        || { echo "client run $1 failed, see $work/$1.log" >&2; return 1; }
+}
+
+stop() {
+    kill "$server" 2>/dev/null
+    wait "$server" 2>/dev/null
+}
+
+"$JAVA" -XX:CRaCCheckpointTo="$image" -cp $CP bench.rmi.CracServer > "$work/server.log" 2>&1 &
+server=$!
+trap stop EXIT
+sleep "$SERVER_WAIT"
+
+client cold || exit 1
+for i in $(seq 1 "$warm_runs"); do
+    client warm || exit 1
+done
+
+"$JCMD" "$server" JDK.checkpoint > "$work/checkpoint.log" 2>&1
+wait "$server"
+if [ ! -f "$image/inventory.img" ]; then
+    echo "checkpoint of the server failed, see $work/checkpoint.log and $work/server.log" >&2
+    exit 1
+fi
+
+"$JAVA" -XX:CRaCRestoreFrom="$image" > "$work/restored-server.log" 2>&1 &
+server=$!
+sleep "$SERVER_WAIT"
+for i in $(seq 1 "$restored_runs"); do
+    client "restored_$i" || exit 1
+done
+
+# Report rows are "<benchmark name> <time> <score>"; the name may have spaces
+times() {
+    awk '$(NF) ~ /^[0-9.]+$/ && $(NF-1) ~ /^[0-9.]+$/ && NF >= 3 {
+        name = $1; for (i = 2; i <= NF - 2; ++i) name = name " " $i; print name "\t" $(NF-1) }' "$work/$1.txt"
+}
+
+tab=$(printf '\t')
+times cold | sort > "$work/joined.tsv"
+for run in warm $(seq -f "restored_%g" 1 "$restored_runs"); do
+    times "$run" | sort | join -t "$tab" "$work/joined.tsv" - > "$work/joined.tmp"
+    mv "$work/joined.tmp" "$work/joined.tsv"
+done
+{
+    printf "benchmark,cold_ms,warm_ms"
+    for i in $(seq 1 "$restored_runs"); do
+        printf ",restored_%d_ms" "$i"
+    done
+    echo ",retained_pct"
+    awk -F '\t' '{
+        gain = $2 - $3
+        retained = gain > 0 ? sprintf("%.1f", 100 * ($2 - $4) / gain) : "NA"
+        printf "\"%s\"", $1
+        for (i = 2; i <= NF; ++i) printf ",%s", $i
+        printf ",%s\n", retained }' "$work/joined.tsv"
+} > "$work/crac.csv"
+cat "$work/crac.csv"
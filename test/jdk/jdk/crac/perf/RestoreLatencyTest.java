@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+ * CA 94089 USA or visit www.azul.com if you need additional information or
+ * have any questions.
+ */
+
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.Properties;
+import java.util.concurrent.CountDownLatch;
+
+import jdk.crac.Core;
+import jdk.test.lib.process.OutputAnalyzer;
+import jdk.test.lib.process.ProcessTools;
+import jtreg.SkippedException;
+
+/*
+ * @test id=hello
+ * @summary Checkpoint and restore latency of a trivial application stays within baseline
+ * @requires os.family == "linux"
+ * @library /test/lib
+ * @run main/othervm/timeout=600 RestoreLatencyTest hello
+ */
+/*
+ * @test id=heap
+ * @summary Checkpoint and restore latency of an application with a populated heap stays within baseline
+ * @requires os.family == "linux"
+ * @library /test/lib
+ * @run main/othervm/timeout=600 RestoreLatencyTest heap
+ */
+/*
+ * @test id=threads
+ * @summary Checkpoint and restore latency of an application with many threads stays within baseline
+ * @requires os.family == "linux"
+ * @library /test/lib
+ * @run main/othervm/timeout=600 RestoreLatencyTest threads
+ */
+
+/**
+ * Checkpoints and restores a reference application several times and
+ * compares the median dump time, restore time and image size, as recorded
+ * by the engine in CRAC_ENGINE_METRICS, with baselines.
+ *
+ * Baselines depend on the host, so the test only runs when it is given
+ * some: -Dcrac.perf.baselines=FILE reads them, as "APP.dump_ms",
+ * "APP.restore_ms" and "APP.image_mb" (see baselines.properties next to this
+ * test). A measurement exceeding its baseline by more than the "tolerance"
+ * (relative, default 0.25) fails the test, and so does a missing baseline,
+ * so that a run without baselines can't pass unchecked.
+ * -Dcrac.perf.update=FILE instead writes the measured values to FILE to be
+ * used as new baselines, and compares nothing.
+ */
+public class RestoreLatencyTest {
+
+    static final int ITERATIONS = Integer.getInteger("crac.perf.iterations", 3);
+    static final String[] METRICS = { "dump_ms", "restore_ms", "image_mb" };
+
+    public static void main(String[] args) throws Exception {
+        if (args.length == 2 && args[0].equals("-app")) {
+            app(args[1]);
+            return;
+        }
+        String app = args[0];
+        String update = System.getProperty("crac.perf.update");
+        String baselinesProp = System.getProperty("crac.perf.baselines");
+        if (update == null && baselinesProp == null) {
+            throw new SkippedException("Performance test, run with -Dcrac.perf.baselines=FILE"
+                    + " or generate FILE with -Dcrac.perf.update=FILE");
+        }
+
+        Map<String, List<Double>> samples = new HashMap<>();
+        for (String m : METRICS) {
+            samples.put(m, new ArrayList<>());
+        }
+        for (int i = 0; i < ITERATIONS; ++i) {
+            Map<String, Double> run = run(app, i);
+            System.out.println(app + " #" + i + ": " + run);
+            for (String m : METRICS) {
+                samples.get(m).add(run.get(m));
+            }
+        }
+
+        Properties measured = new Properties();
+        for (String m : METRICS) {
+            measured.setProperty(app + "." + m, String.format("%.1f", median(samples.get(m))));
+        }
+        System.out.println("Measured: " + measured);
+
+        if (update != null) {
+            Properties props = load(Paths.get(update));
+            props.putAll(measured);
+            try (OutputStream os = Files.newOutputStream(Paths.get(update))) {
+                props.store(os, "CRaC restore latency baselines");
+            }
+            System.out.println("Baselines written to " + update);
+            return;
+        }
+
+        Path baselinesFile = Paths.get(baselinesProp);
+        Properties baselines = load(baselinesFile);
+        double tolerance = Double.parseDouble(baselines.getProperty("tolerance", "0.25"));
+        List<String> regressions = new ArrayList<>();
+        List<String> missing = new ArrayList<>();
+        for (String m : METRICS) {
+            String key = app + "." + m;
+            String baseline = baselines.getProperty(key);
+            if (baseline == null) {
+                missing.add(key);
+                continue;
+            }
+            double limit = Double.parseDouble(baseline) * (1 + tolerance);
+            double value = Double.parseDouble(measured.getProperty(key));
+            System.out.printf("%s: %.1f, baseline %s, limit %.1f%n", key, value, baseline, limit);
+            if (value > limit) {
+                regressions.add(String.format("%s is %.1f, baseline %s", key, value, baseline));
+            }
+        }
+        if (!regressions.isEmpty()) {
+            throw new RuntimeException("Regression against baseline: " + regressions);
+        }
+        if (!missing.isEmpty()) {
+            throw new RuntimeException("No baseline for " + missing + " in " + baselinesFile
+                    + ", generate them on the reference host with -Dcrac.perf.update=FILE");
+        }
+    }
+
+    static Map<String, Double> run(String app, int iteration) throws Exception {
+        Path imagedir = Paths.get("cr-" + app + "-" + iteration).toAbsolutePath();
+        Path metrics = Paths.get("metrics-" + app + "-" + iteration).toAbsolutePath();
+        Files.deleteIfExists(metrics);
+
+        ProcessBuilder pb = ProcessTools.createJavaProcessBuilder(
+                "-XX:CRaCCheckpointTo=" + imagedir, "-Xmx1g",
+                "-cp", System.getProperty("test.class.path"),
+                RestoreLatencyTest.class.getName(), "-app", app);
+        pb.environment().put("CRAC_ENGINE_METRICS", metrics.toString());
+        OutputAnalyzer out = new OutputAnalyzer(pb.start());
+        out.shouldNotContain("CheckpointException");
+        // CRIU kills the JVM with SIGKILL once the image is complete
+        out.shouldHaveExitValue(137);
+        Map<String, String> dump = record(metrics, "checkpoint");
+
+        pb = ProcessTools.createJavaProcessBuilder("-XX:CRaCRestoreFrom=" + imagedir);
+        pb.environment().put("CRAC_ENGINE_METRICS", metrics.toString());
+        out = new OutputAnalyzer(pb.start());
+        out.shouldHaveExitValue(0);
+        out.shouldContain("RESTORED " + app);
+        Map<String, String> restore = record(metrics, "restore");
+
+        Map<String, Double> result = new HashMap<>();
+        result.put("dump_ms", Long.parseLong(dump.get("duration_ns")) / 1e6);
+        result.put("restore_ms", Long.parseLong(restore.get("duration_ns")) / 1e6);
+        result.put("image_mb", Long.parseLong(dump.get("image_bytes")) / 1048576.0);
+        return result;
+    }
+
+    // The last successful record of the operation in the engine metrics
+    static Map<String, String> record(Path metrics, String op) throws IOException {
+        Map<String, String> found = null;
+        for (String line : Files.readAllLines(metrics)) {
+            Map<String, String> fields = new HashMap<>();
+            for (String kv : line.trim().split(" ")) {
+                int eq = kv.indexOf('=');
+                if (eq > 0) {
+                    fields.put(kv.substring(0, eq), kv.substring(eq + 1));
+                }
+            }
+            if (op.equals(fields.get("op")) && "ok".equals(fields.get("result"))) {
+                found = fields;
+            }
+        }
+        if (found == null) {
+            throw new RuntimeException("No successful " + op + " recorded in " + metrics);
+        }
+        return found;
+    }
+
+    static Properties load(Path file) throws IOException {
+        Properties props = new Properties();
+        if (Files.exists(file)) {
+            try (InputStream is = Files.newInputStream(file)) {
+                props.load(is);
+            }
+        }
+        return props;
+    }
+
+    static double median(List<Double> values) {
+        Double[] sorted = values.toArray(new Double[0]);
+        Arrays.sort(sorted);
+        return sorted[sorted.length / 2];
+    }
+
+    // Reference applications, run in the checkpointed JVM
+
+    static Object retained;
+
+    static void app(String app) throws Exception {
+        switch (app) {
+            case "hello":
+                break;
+            case "heap": {
+                // ~256M of live objects of mixed sizes
+                List<Object> list = new ArrayList<>();
+                for (int i = 0; i < 1 << 20; ++i) {
+                    list.add(new byte[64 + (i % 7) * 64]);
+                    list.add(Integer.toString(i));
+                }
+                retained = list;
+                break;
+            }
+            case "threads": {
+                CountDownLatch latch = new CountDownLatch(1);
+                for (int i = 0; i < 1000; ++i) {
+                    Thread t = new Thread(() -> {
+                        try {
+                            latch.await();
+                        } catch (InterruptedException e) {
+                        }
+                    });
+                    t.setDaemon(true);
+                    t.start();
+                }
+                retained = latch;
+                break;
+            }
+            default:
+                throw new IllegalArgumentException(app);
+        }
+        Core.checkpointRestore();
+        System.out.println("RESTORED " + app);
+    }
+}
@@ -0,0 +1,129 @@
+#
+# Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+# DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+#
+# This code is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 only, as
+# published by the Free Software Foundation.
+#
+# This code is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# version 2 for more details (a copy is included in the LICENSE file that
+# accompanied this code).
+#
+# You should have received a copy of the GNU General Public License version
+# 2 along with this work; if not, write to the Free Software Foundation,
+# Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+# Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+# CA 94089 USA or visit www.azul.com if you need additional information or
+# have any questions.
+#
+
+# Common definitions for the CRaC benchmark scripts, to be sourced.
+#
+# Environment:
+#   JAVA_HOME        CRaC JDK to benchmark (default: java on PATH)
+#   BENCH_WORK       scratch directory for images and logs (default: ./work)
+#   JAVA_OPTS        extra JVM options for the checkpointed Workload
+#   UFFD_THREADS     page injection threads of the eager mode (default: nproc)
+
+BENCH_DIR=$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)
+BENCH_JAR=$BENCH_DIR/dist/crac-bench.jar
+BENCH_WORK=${BENCH_WORK:-$PWD/work}
+
+if [ -n "$JAVA_HOME" ]; then
+    JAVA=$JAVA_HOME/bin/java
+    JCMD=$JAVA_HOME/bin/jcmd
+else
+    JAVA=java
+    JCMD=jcmd
+fi
+ENGINE=$(dirname "$(readlink -f "$(command -v "$JAVA")")")/../lib/criuengine
+
+die() {
+    echo "$(basename "$0"): $*" >&2
+    exit 1
+}
+
+[ -f "$BENCH_JAR" ] || die "$BENCH_JAR not found, run make first"
+
+# Environment for the engine in the given restore mode, on stdout.
+# The same is used for checkpoint and restore; each side of the engine only
+# looks at the variables that concern it. The optimized mode is a plain
+# image rewritten by criuengine optimize, see make_image. The eager mode
+# injects lazy pages by userfaultfd from engine threads. The pidns mode
+# restores into a new pid namespace.
+mode_env() {
+    case "$1" in
+        restore|optimized) ;;
+        verify)    echo "CRAC_IMAGE_CHECKSUMS=1" ;;
+        encrypted) echo "CRAC_IMAGE_KEY_FILE=$BENCH_WORK/image.key" ;;
+        timens)    echo "CRAC_RESTORE_TIMENS=auto" ;;
+        eager)     echo "CRAC_RESTORE_UFFD_THREADS=${UFFD_THREADS:-$(nproc)}" ;;
+        pidns)     echo "CRAC_RESTORE_PIDNS=always" ;;
+        *)         die "unknown mode $1" ;;
+    esac
+}
+
+RESTORE_MODES="restore optimized eager verify encrypted timens pidns"
+
+# Creates a warmed-up checkpoint of the Workload.
+# Usage: make_image MODE IMAGEDIR PORTDIR [WORKLOAD_OPTIONS...]
+make_image() {
+    local mode=$1 imagedir=$2 portdir=$3
+    shift 3
+    rm -rf "$imagedir"
+    mkdir -p "$imagedir"
+    [ -f "$BENCH_WORK/image.key" ] || head -c 32 /dev/urandom > "$BENCH_WORK/image.key"
+    env $(mode_env "$mode") "$JAVA" $JAVA_OPTS -XX:CRaCCheckpointTo="$imagedir" -cp "$BENCH_JAR" \
+        cracbench.Workload --port-dir "$portdir" --warmup 20000 --checkpoint "$@" \
+        > "$imagedir.checkpoint.log" 2>&1
+    [ -f "$imagedir/inventory.img" ] || [ -n "$(ls -d "$imagedir"/mem*m-cpu* 2>/dev/null)" ] \
+        || die "checkpoint failed, see $imagedir.checkpoint.log"
+    if [ "$mode" = optimized ]; then
+        "$ENGINE" optimize "$imagedir" >> "$imagedir.checkpoint.log" 2>&1 \
+            || die "optimize failed, see $imagedir.checkpoint.log"
+    fi
+}
+
+# Runs Probe on a command; prints "READY_MS FIRST_RESPONSE_MS", or "NA NA"
+# if the command never served a request.
+# Usage: probe PORTDIR COMMAND...
+probe() {
+    local portdir=$1
+    shift
+    "$JAVA" -cp "$BENCH_JAR" cracbench.Probe --port-dir "$portdir" -- "$@" 2>/dev/null \
+        | sed -n 's/^ready_ms=\([^ ]*\) first_response_ms=\([^ ]*\).*/\1 \2/p;s/^error=.*/NA NA/p' \
+        | tail -1
+}
+
+# Number of records in the engine metrics file. Taken before a run and
+# passed to metric as SINCE, it keeps the records of earlier runs out.
+# Usage: records FILE
+records() {
+    cat "$1" 2>/dev/null | wc -l
+}
+
+# Field of the last successful record of an operation in the engine metrics
+# file after its first SINCE records, or NA if there is none.
+# Usage: metric FILE OP FIELD [SINCE]
+metric() {
+    awk -v op="op=$2" -v f="$3=" -v since="${4:-0}" '
+        NR <= since { next }
+        { found = 0; ok = 0; for (i = 1; i <= NF; ++i) { found = found || $i == op; ok = ok || $i == "result=ok" } }
+        found && ok { v = "NA"; for (i = 1; i <= NF; ++i) if (index($i, f) == 1) v = substr($i, length(f) + 1) }
+        END { print v == "" ? "NA" : v }' "$1" 2>/dev/null || echo NA
+}
+
+# Reads numbers on stdin, prints "N MEAN P50 P90 P99 MAX"
+distribution() {
+    sort -g | awk '
+        { v[NR] = $1; sum += $1 }
+        function pct(p,  i) { i = int(p * NR + 0.999999); if (i < 1) i = 1; return v[i] }
+        END {
+            if (NR == 0) { print "0 NA NA NA NA NA"; exit }
+            printf "%d %.3f %.3f %.3f %.3f %.3f\n", NR, sum / NR, pct(0.5), pct(0.9), pct(0.99), v[NR]
+        }'
+}
@@ -0,0 +1,185 @@
+#!/bin/bash
+#
+# Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+# DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+#
+# This code is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 only, as
+# published by the Free Software Foundation.
+#
+# This code is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# version 2 for more details (a copy is included in the LICENSE file that
+# accompanied this code).
+#
+# You should have received a copy of the GNU General Public License version
+# 2 along with this work; if not, write to the Free Software Foundation,
+# Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+# Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+# CA 94089 USA or visit www.azul.com if you need additional information or
+# have any questions.
+
+# Many restores of one image at once, as on a node reboot or scale-out.
+#
+# Usage: density.sh [-N "COUNTS"] [-c] [-o OUT.csv]
+#   COUNTS   numbers of concurrent restores (default: 1 2 4 8 16 32 64)
+#   -c       drop the image from the page cache before every round
+#
+# Every round launches N restores of the same Workload image through
+# java -XX:CRaCRestoreFrom, i.e. criuengine restore, and waits until all of
+# them have announced their ports. CRIU restores the original pids, so as
+# root every copy is restored in its own pid namespace by the engine
+# (CRAC_RESTORE_PIDNS=always); without it, more than one copy cannot be
+# restored at a time.
+#
+# Reported per round: time until all copies were ready and the spread of
+# the per-copy times, the engine's restore times, CPU busy and iowait
+# shares and the utilisation and read rate of the disk holding the image
+# over the round, and the memory of the restored JVMs once all are up:
+# their summed PSS, which counts shared image pages once, and the drop of
+# MemAvailable. Per-copy times go to OUT-instances.csv: each copy records
+# its restore into its own metrics file, and its port is found through the
+# process listening on it (ss) and the launcher that process descends from.
+
+. "$(dirname "$0")/common.sh"
+
+counts="1 2 4 8 16 32 64"
+cold=false
+out=density.csv
+while getopts "N:co:" opt; do
+    case $opt in
+        N) counts=$OPTARG ;;
+        c) cold=true ;;
+        o) out=$OPTARG ;;
+        *) die "usage: density.sh [-N COUNTS] [-c] [-o OUT.csv]" ;;
+    esac
+done
+
+IMGSTAT=$BENCH_DIR/dist/imgstat
+[ -x "$IMGSTAT" ] || die "$IMGSTAT not found, run make first"
+
+mkdir -p "$BENCH_WORK"
+export CRAC_ENGINE_METRICS=$BENCH_WORK/density.metrics
+rm -f "$CRAC_ENGINE_METRICS"
+image=$BENCH_WORK/density
+portdir=$BENCH_WORK/density.ports
+make_image restore "$image" "$portdir"
+
+pidns=false
+[ "$(id -u)" = 0 ] && pidns=true
+
+# Disk the image is read from, as named in /proc/diskstats
+disk=$(basename "$(readlink -f "$(df --output=source "$image" | tail -1)")")
+grep -q " $disk " /proc/diskstats || disk=
+
+now_ns() {
+    date +%s%N
+}
+
+# "BUSY TOTAL IOWAIT" jiffies over all CPUs
+cpu_sample() {
+    awk '/^cpu / { t = 0; for (i = 2; i <= NF; ++i) t += $i; print t - $5 - $6, t, $6 }' /proc/stat
+}
+
+# Copy that a process belongs to: the index of the launcher it descends
+# from, as CRIU restores the JVM under the process that ran the restore
+copy_of() {
+    local pid=$1 i
+    while [ -n "$pid" ] && [ "$pid" -gt 1 ]; do
+        for i in "${!launchers[@]}"; do
+            [ "${launchers[$i]}" = "$pid" ] && echo $((i + 1)) && return
+        done
+        pid=$(awk '/^PPid:/ { print $2 }' "/proc/$pid/status" 2>/dev/null)
+    done
+}
+
+# "IO_TICKS_MS SECTORS_READ" of the image's disk
+disk_sample() {
+    [ -n "$disk" ] && awk -v d="$disk" '$3 == d { print $13, $6 }' /proc/diskstats || echo "NA NA"
+}
+
+echo "n,ready_all_ms,ready_p50_ms,ready_max_ms,restore_p50_ms,restore_max_ms,cpu_busy_pct,iowait_pct,disk_util_pct,disk_read_mb_s,pss_total_mb,pss_per_copy_mb,mem_used_mb" > "$out"
+echo "n,copy,ready_ms,restore_ms" > "${out%.csv}-instances.csv"
+for n in $counts; do
+    if [ "$n" -gt 1 ] && ! $pidns; then
+        echo "skipping $n copies: concurrent restores need root for pid namespaces" >&2
+        continue
+    fi
+    rm -rf "$portdir"
+    mkdir -p "$portdir"
+    $cold && "$IMGSTAT" evict "$image"
+    mem0=$(awk '/^MemAvailable:/ { print $2 }' /proc/meminfo)
+    read -r busy0 total0 iowait0 < <(cpu_sample)
+    read -r ticks0 sectors0 < <(disk_sample)
+    start=$(now_ns)
+
+    # Each copy records its restore into its own metrics file
+    launchers=()
+    for i in $(seq 1 "$n"); do
+        rm -f "$BENCH_WORK/density-$i.metrics"
+        if $pidns; then
+            CRAC_ENGINE_METRICS=$BENCH_WORK/density-$i.metrics CRAC_RESTORE_PIDNS=always \
+                "$JAVA" -XX:CRaCRestoreFrom="$image" > "$image.restore-$i.log" 2>&1 &
+        else
+            CRAC_ENGINE_METRICS=$BENCH_WORK/density-$i.metrics \
+                "$JAVA" -XX:CRaCRestoreFrom="$image" > "$image.restore-$i.log" 2>&1 &
+        fi
+        launchers+=($!)
+    done
+
+    for t in $(seq 1 6000); do
+        [ "$(ls "$portdir" | grep -c '^port-[0-9]*$')" -ge "$n" ] && break
+        sleep 0.05
+    done
+    end=$(now_ns)
+    read -r busy1 total1 iowait1 < <(cpu_sample)
+    read -r ticks1 sectors1 < <(disk_sample)
+
+    # Per copy: announcement time of its port, found through the process
+    # listening on it, and the engine's restore time
+    for f in "$portdir"/port-*[0-9]; do
+        [ -e "$f" ] || continue
+        pid=$(ss -Hltnp "sport = :$(cat "$f")" | sed -n 's/.*pid=\([0-9]*\).*/\1/p' | head -1)
+        echo "$(copy_of "$pid") $(stat -c %.9Y "$f")"
+    done | awk -v s="$start" '$1 != "" { printf "%s %.1f\n", $1, ($2 * 1e9 - s) / 1e6 }' > "$BENCH_WORK/density.ready"
+    for i in $(seq 1 "$n"); do
+        ready_ms=$(awk -v c="$i" '$1 == c { print $2 }' "$BENCH_WORK/density.ready")
+        restore_ns=$(metric "$BENCH_WORK/density-$i.metrics" restore duration_ns)
+        awk -v n="$n" -v c="$i" -v d="${ready_ms:-NA}" -v r="$restore_ns" '
+            BEGIN { printf "%s,%s,%s,%s\n", n, c, d, (r == "NA" ? "NA" : sprintf("%.1f", r / 1e6)) }'
+    done >> "${out%.csv}-instances.csv"
+    tail -n "$n" "${out%.csv}-instances.csv" | awk -F, '$3 != "NA" { print $3 }' > "$BENCH_WORK/density.ready"
+    tail -n "$n" "${out%.csv}-instances.csv" | awk -F, '$4 != "NA" { print $4 }' > "$BENCH_WORK/density.restore"
+
+    pss=0
+    copies=0
+    for pid in $(pgrep -f "cracbench.Workload --port-dir $portdir"); do
+        kb=$(awk '/^Pss:/ { print $2 }' "/proc/$pid/smaps_rollup" 2>/dev/null)
+        [ -n "$kb" ] && pss=$((pss + kb)) && copies=$((copies + 1))
+    done
+    mem1=$(awk '/^MemAvailable:/ { print $2 }' /proc/meminfo)
+
+    ready=$(distribution < "$BENCH_WORK/density.ready")
+    restore=$(distribution < "$BENCH_WORK/density.restore")
+    awk -v n="$n" -v s="$start" -v e="$end" -v ready="$ready" -v restore="$restore" \
+        -v b0="$busy0" -v b1="$busy1" -v t0="$total0" -v t1="$total1" -v w0="$iowait0" -v w1="$iowait1" \
+        -v k0="$ticks0" -v k1="$ticks1" -v r0="$sectors0" -v r1="$sectors1" \
+        -v pss="$pss" -v copies="$copies" -v m0="$mem0" -v m1="$mem1" '
+        function pct(a, b) { return b > 0 ? sprintf("%.1f", 100 * a / b) : "NA" }
+        BEGIN {
+            split(ready, rd, " "); split(restore, rs, " ")
+            ms = (e - s) / 1e6
+            util = k0 == "NA" ? "NA" : pct(k1 - k0, ms)
+            rate = r0 == "NA" ? "NA" : sprintf("%.1f", (r1 - r0) * 512 / 1048576 / (ms / 1000))
+            printf "%s,%.1f,%s,%s,%s,%s,%s,%s,%s,%s,%.1f,%s,%.1f\n", n, ms, rd[3], rd[6], rs[3], rs[6],
+                pct(b1 - b0, t1 - t0), pct(w1 - w0, t1 - t0), util, rate, pss / 1024,
+                (copies > 0 ? sprintf("%.1f", pss / 1024 / copies) : "NA"), (m0 - m1) / 1024
+        }' >> "$out"
+    tail -1 "$out" >&2
+
+    kill "${launchers[@]}" 2>/dev/null
+    wait "${launchers[@]}" 2>/dev/null
+done
+cat "$out"
@@ -0,0 +1,104 @@
+#!/bin/bash
+#
+# Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+# DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+#
+# This code is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 only, as
+# published by the Free Software Foundation.
+#
+# This code is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# version 2 for more details (a copy is included in the LICENSE file that
+# accompanied this code).
+#
+# You should have received a copy of the GNU General Public License version
+# 2 along with this work; if not, write to the Free Software Foundation,
+# Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+# Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+# CA 94089 USA or visit www.azul.com if you need additional information or
+# have any questions.
+
+# Image size and restore behaviour of the Workload under each collector,
+# with and without a full GC right before the checkpoint.
+#
+# Usage: gcmatrix.sh [-n ITERATIONS] [-g "GCS"] [-d SECONDS] [-o OUT.csv]
+#   GCS       collectors to try, as in -XX:+Use<GC>GC (default: Serial Parallel G1 Z)
+#   SECONDS   how long to measure throughput after restore (default: 60)
+#
+# Every configuration is checkpointed after the same warm-up with the heap
+# size fixed by -Xms/-Xmx (JAVA_OPTS are added after). Reported per run:
+# image size, the share of dumped pages that are all zeros, dump and
+# restore time from the engine metrics, and the requests per second served
+# from the restore on. A configuration that cannot be checkpointed is
+# reported with NA values.
+
+. "$(dirname "$0")/common.sh"
+
+iterations=1
+gcs="Serial Parallel G1 Z"
+duration=60
+heap=512m
+out=gcmatrix.csv
+while getopts "n:g:d:o:" opt; do
+    case $opt in
+        n) iterations=$OPTARG ;;
+        g) gcs=$OPTARG ;;
+        d) duration=$OPTARG ;;
+        o) out=$OPTARG ;;
+        *) die "usage: gcmatrix.sh [-n ITERATIONS] [-g GCS] [-d SECONDS] [-o OUT.csv]" ;;
+    esac
+done
+
+IMGSTAT=$BENCH_DIR/dist/imgstat
+[ -x "$IMGSTAT" ] || die "$IMGSTAT not found, run make first"
+
+mkdir -p "$BENCH_WORK"
+export CRAC_ENGINE_METRICS=$BENCH_WORK/gcmatrix.metrics
+rm -f "$CRAC_ENGINE_METRICS"
+echo "gc,full_gc,iteration,image_mb,zero_pct,dump_ms,restore_ms,rps" > "$out"
+
+for gc in $gcs; do
+    for fullgc in no yes; do
+        name=$gc-$fullgc
+        image=$BENCH_WORK/gcmatrix-$name
+        portdir=$BENCH_WORK/gcmatrix-$name.ports
+        opts=()
+        [ "$fullgc" = yes ] && opts=(--full-gc)
+        for i in $(seq 1 "$iterations"); do
+            since=$(records "$CRAC_ENGINE_METRICS")
+            # make_image dies on failure, keep going with the other collectors
+            if ! (JAVA_OPTS="-XX:+Use${gc}GC -Xms$heap -Xmx$heap $JAVA_OPTS" \
+                    make_image restore "$image" "$portdir" "${opts[@]}"); then
+                echo "$gc,$fullgc,$i,NA,NA,NA,NA,NA" >> "$out"
+                continue
+            fi
+            dump_ns=$(metric "$CRAC_ENGINE_METRICS" checkpoint duration_ns "$since")
+            read -r image_bytes pages zero_pages < <("$IMGSTAT" zero "$image" \
+                | sed 's/image_bytes=\([0-9]*\).* pages=\([0-9]*\) zero_pages=\([0-9]*\)/\1 \2 \3/')
+
+            rm -rf "$portdir"
+            mkdir -p "$portdir"
+            "$JAVA" -XX:CRaCRestoreFrom="$image" > "$image.restore.log" 2>&1 &
+            pid=$!
+            rps=$("$JAVA" -cp "$BENCH_JAR" cracbench.LoadGen --port-dir "$portdir" --duration "$duration" \
+                | sed -n 's/.* rps=//p')
+            kill "$pid" 2>/dev/null
+            wait "$pid" 2>/dev/null
+            restore_ns=$(metric "$CRAC_ENGINE_METRICS" restore duration_ns "$since")
+
+            awk -v g="$gc" -v f="$fullgc" -v i="$i" -v b="$image_bytes" -v p="$pages" -v z="$zero_pages" \
+                -v d="$dump_ns" -v r="$restore_ns" -v t="${rps:-NA}" '
+                function ms(ns) { return ns == "NA" ? "NA" : sprintf("%.1f", ns / 1e6) }
+                BEGIN {
+                    printf "%s,%s,%s,%.1f,%s,%s,%s,%s\n", g, f, i, b / 1048576,
+                        (p > 0 ? sprintf("%.1f", 100 * z / p) : "NA"), ms(d), ms(r), t
+                }' >> "$out"
+            tail -1 "$out" >&2
+            rm -rf "$image"
+        done
+    done
+done
+cat "$out"
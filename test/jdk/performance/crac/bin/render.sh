@@ -0,0 +1,112 @@
+#!/bin/bash
+#
+# Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+# DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+#
+# This code is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 only, as
+# published by the Free Software Foundation.
+#
+# This code is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# version 2 for more details (a copy is included in the LICENSE file that
+# accompanied this code).
+#
+# You should have received a copy of the GNU General Public License version
+# 2 along with this work; if not, write to the Free Software Foundation,
+# Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+# Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+# CA 94089 USA or visit www.azul.com if you need additional information or
+# have any questions.
+
+# Java2D warm-up retention: frame times right after restore against a cold
+# start and a warmed-up JVM.
+#
+# Usage: render.sh [-n ITERATIONS] [-w WARMUP] [-s SECONDS] [-o OUT.csv]
+#   WARMUP    seconds to render before checkpoint or measurement (default: 30)
+#   SECONDS   length of the measured period (default: 5)
+#
+# Modes:
+#   cold      a new JVM measures right away
+#   warm      a new JVM measures after the warm-up, the best case
+#   restored  the JVM is checkpointed after the warm-up, once, and every
+#             iteration measures right after restoring it
+#
+# Rendering is headless into an offscreen image. An on-screen window, on
+# Xvfb or otherwise, holds a connection to the X server for the life of the
+# toolkit, which a checkpoint cannot take along.
+#
+# Writes a row per run to OUT.csv, with launch_to_first_frame_ms measured
+# from the launch of java.
+
+. "$(dirname "$0")/common.sh"
+
+iterations=5
+warmup=30
+measure=5
+out=render.csv
+while getopts "n:w:s:o:" opt; do
+    case $opt in
+        n) iterations=$OPTARG ;;
+        w) warmup=$OPTARG ;;
+        s) measure=$OPTARG ;;
+        o) out=$OPTARG ;;
+        *) die "usage: render.sh [-n ITERATIONS] [-w WARMUP] [-s SECONDS] [-o OUT.csv]" ;;
+    esac
+done
+
+mkdir -p "$BENCH_WORK"
+result=$BENCH_WORK/render.result
+
+# Usage: record MODE ITERATION LAUNCH_NS
+record() {
+    local line
+    line=$(cat "$result" 2>/dev/null)
+    [ -n "$line" ] || line="error=noresult"
+    echo "$line" | awk -v m="$1" -v i="$2" -v l="$3" '
+        {
+            for (f = 1; f <= NF; ++f) { split($f, kv, "="); v[kv[1]] = kv[2] }
+            if ("error" in v) { printf "%s,%s,NA,NA,NA,NA,NA,NA,NA,%s\n", m, i, v["error"]; exit }
+            printf "%s,%s,%.1f,%s,%s,%s,%s,%s,%s,\n", m, i,
+                (v["start_ns"] - l) / 1e6 + v["first_frame_ms"], v["first_frame_ms"],
+                v["first_second_frames"], v["p50_ms"], v["p99_ms"], v["max_ms"], v["fps"]
+        }' >> "$out"
+    tail -1 "$out" >&2
+}
+
+echo "mode,iteration,launch_to_first_frame_ms,first_frame_ms,first_second_frames,p50_ms,p99_ms,max_ms,fps,error" > "$out"
+opts=(-cp "$BENCH_JAR" -Djava.awt.headless=true)
+render=(cracbench.Render --out "$result" --measure "$measure")
+
+for i in $(seq 1 "$iterations"); do
+    for mode in cold warm; do
+        rm -f "$result"
+        w=0
+        [ "$mode" = warm ] && w=$warmup
+        launch=$(date +%s%N)
+        "$JAVA" $JAVA_OPTS "${opts[@]}" "${render[@]}" --warmup "$w" > "$BENCH_WORK/render.log" 2>&1
+        record "$mode" "$i" "$launch"
+    done
+done
+
+image=$BENCH_WORK/render
+rm -rf "$image" "$result"
+mkdir -p "$image"
+"$JAVA" $JAVA_OPTS -XX:CRaCCheckpointTo="$image" "${opts[@]}" "${render[@]}" --warmup "$warmup" --checkpoint \
+    > "$image.checkpoint.log" 2>&1
+if [ ! -f "$image/inventory.img" ]; then
+    # The checkpoint's error, in every restored row
+    for i in $(seq 1 "$iterations"); do
+        record restored "$i" 0
+    done
+else
+    for i in $(seq 1 "$iterations"); do
+        rm -f "$result"
+        launch=$(date +%s%N)
+        "$JAVA" -XX:CRaCRestoreFrom="$image" > "$image.restore.log" 2>&1
+        record restored "$i" "$launch"
+    done
+fi
+cat "$out"
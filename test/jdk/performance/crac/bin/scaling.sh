@@ -0,0 +1,159 @@
+#!/bin/bash
+#
+# Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+# DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+#
+# This code is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 only, as
+# published by the Free Software Foundation.
+#
+# This code is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# version 2 for more details (a copy is included in the LICENSE file that
+# accompanied this code).
+#
+# You should have received a copy of the GNU General Public License version
+# 2 along with this work; if not, write to the Free Software Foundation,
+# Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+# Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+# CA 94089 USA or visit www.azul.com if you need additional information or
+# have any questions.
+
+# How checkpoint and restore scale with heap size and thread count.
+#
+# Usage: scaling.sh [-H "HEAP_MB..."] [-t "THREADS..."] [-o OUT.csv]
+#   HEAP_MB   live heap sizes to sweep (default: 256 to 32768, doubling)
+#   THREADS   thread counts to sweep (default: 50 100 500 1000 5000 10000)
+#
+# For every point the Workload is checkpointed and restored once. The
+# engine metrics provide the time CRIU spent freezing the JVM, the time it
+# was kept frozen, the dump and restore times and CRIU's peak RSS on both
+# sides. Heap sizes the host has no memory for are skipped.
+#
+# Writes a row per point to OUT.csv and, per sweep and metric, the fitted
+# linear slope and the exponent of a power-law fit to OUT-fit.csv. An
+# exponent well above 1 marks superlinear growth. With gnuplot, the curves
+# are drawn to OUT-heap.png and OUT-threads.png.
+
+. "$(dirname "$0")/common.sh"
+
+heaps="256 512 1024 2048 4096 8192 16384 32768"
+threads="50 100 500 1000 5000 10000"
+out=scaling.csv
+while getopts "H:t:o:" opt; do
+    case $opt in
+        H) heaps=$OPTARG ;;
+        t) threads=$OPTARG ;;
+        o) out=$OPTARG ;;
+        *) die "usage: scaling.sh [-H HEAP_MB...] [-t THREADS...] [-o OUT.csv]" ;;
+    esac
+done
+
+mkdir -p "$BENCH_WORK"
+export CRAC_ENGINE_METRICS=$BENCH_WORK/scaling.metrics
+rm -f "$CRAC_ENGINE_METRICS"
+available_mb=$(awk '/^MemAvailable:/ { print int($2 / 1024) }' /proc/meminfo)
+
+ms() {
+    [ "$1" = NA ] && echo NA || awk -v v="$1" 'BEGIN { printf "%.1f", v / 1e6 }'
+}
+
+mb() {
+    [ "$1" = NA ] && echo NA || awk -v v="$1" -v d="$2" 'BEGIN { printf "%.1f", v / d }'
+}
+
+# Usage: point SWEEP X HEAP_MB THREADS
+point() {
+    local sweep=$1 x=$2 heap=$3 nthreads=$4
+    local image=$BENCH_WORK/scaling-$sweep-$x portdir=$BENCH_WORK/scaling.ports
+    local m=$CRAC_ENGINE_METRICS
+    local since=$(records "$m")
+    # Room for the live data, the warm-up garbage and the dump
+    local xmx=$((heap + heap / 4 + 256))
+    if ! (JAVA_OPTS="-Xmx${xmx}m -Xss256k $JAVA_OPTS" \
+            make_image restore "$image" "$portdir" --heap-mb "$heap" --threads "$nthreads"); then
+        echo "$sweep,$x,NA,NA,NA,NA,NA,NA,NA" >> "$out"
+        return
+    fi
+    local freezing=$(metric "$m" checkpoint freezing_ns "$since") frozen=$(metric "$m" checkpoint frozen_ns "$since")
+    local dump=$(metric "$m" checkpoint duration_ns "$since")
+    local dump_rss=$(metric "$m" checkpoint criu_maxrss_kb "$since")
+    local image_bytes=$(metric "$m" checkpoint image_bytes "$since")
+    since=$(records "$m")
+    probe "$portdir" "$JAVA" -XX:CRaCRestoreFrom="$image" > /dev/null
+    local restore=$(metric "$m" restore duration_ns "$since")
+    local restore_rss=$(metric "$m" restorerss criu_maxrss_kb "$since")
+    local row="$sweep,$x,$(ms "$freezing"),$(ms "$frozen"),$(ms "$dump"),$(ms "$restore")"
+    row="$row,$(mb "$dump_rss" 1024),$(mb "$restore_rss" 1024),$(mb "$image_bytes" 1048576)"
+    echo "$row" >> "$out"
+    tail -1 "$out" >&2
+    rm -rf "$image"
+}
+
+echo "sweep,x,freezing_ms,frozen_ms,dump_ms,restore_ms,dump_criu_rss_mb,restore_criu_rss_mb,image_mb" > "$out"
+for heap in $heaps; do
+    if [ $((heap + heap / 4 + 1024)) -gt "$available_mb" ]; then
+        echo "skipping heap $heap MB, only $available_mb MB available" >&2
+        continue
+    fi
+    point heap "$heap" "$heap" 0
+done
+for n in $threads; do
+    point threads "$n" 0 "$n"
+done
+
+# Least squares fits per sweep and metric: y = a + b x, and log y = c + e log x
+fit=${out%.csv}-fit.csv
+echo "sweep,metric,points,slope,exponent,growth" > "$fit"
+awk -F, '
+    NR == 1 { for (i = 3; i <= NF; ++i) name[i] = $i; cols = NF; next }
+    {
+        for (i = 3; i <= cols; ++i) {
+            if ($i == "NA") continue
+            k = $1 SUBSEP i
+            n[k]++; sx[k] += $2; sy[k] += $i; sxx[k] += $2 * $2; sxy[k] += $2 * $i
+            if ($2 > 0 && $i > 0) {
+                lx = log($2); ly = log($i)
+                ln[k]++; lsx[k] += lx; lsy[k] += ly; lsxx[k] += lx * lx; lsxy[k] += lx * ly
+            }
+        }
+    }
+    function slope(n, sx, sy, sxx, sxy,  d) {
+        d = n * sxx - sx * sx
+        return d == 0 ? "NA" : (n * sxy - sx * sy) / d
+    }
+    END {
+        for (k in n) {
+            split(k, p, SUBSEP)
+            b = n[k] >= 2 ? slope(n[k], sx[k], sy[k], sxx[k], sxy[k]) : "NA"
+            e = ln[k] >= 2 ? slope(ln[k], lsx[k], lsy[k], lsxx[k], lsxy[k]) : "NA"
+            growth = e == "NA" ? "NA" : e > 1.15 ? "superlinear" : e < 0.85 ? "sublinear" : "linear"
+            printf "%s,%s,%d,%s,%s,%s\n", p[1], name[p[2]], n[k],
+                b == "NA" ? b : sprintf("%.6g", b), e == "NA" ? e : sprintf("%.3f", e), growth
+        }
+    }' "$out" | sort >> "$fit"
+
+if command -v gnuplot > /dev/null; then
+    for sweep in heap threads; do
+        grep -q "^$sweep," "$out" || continue
+        gnuplot <<GP
+set terminal png size 1000,700
+set output "${out%.csv}-$sweep.png"
+set datafile separator ","
+set logscale xy
+set key top left
+set xlabel "$([ $sweep = heap ] && echo "live heap (MB)" || echo "threads")"
+set ylabel "ms / MB"
+data = "< grep ^$sweep, $out"
+plot data using 2:3 with linespoints title "freezing ms", \
+     data using 2:4 with linespoints title "frozen ms", \
+     data using 2:5 with linespoints title "dump ms", \
+     data using 2:6 with linespoints title "restore ms", \
+     data using 2:7 with linespoints title "dump CRIU RSS MB", \
+     data using 2:8 with linespoints title "restore CRIU RSS MB"
+GP
+    done
+fi
+cat "$out" "$fit"
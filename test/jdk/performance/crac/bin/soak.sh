@@ -0,0 +1,166 @@
+#!/bin/bash
+#
+# Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+# DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+#
+# This code is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 only, as
+# published by the Free Software Foundation.
+#
+# This code is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# version 2 for more details (a copy is included in the LICENSE file that
+# accompanied this code).
+#
+# You should have received a copy of the GNU General Public License version
+# 2 along with this work; if not, write to the Free Software Foundation,
+# Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+# Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+# CA 94089 USA or visit www.azul.com if you need additional information or
+# have any questions.
+
+# Drift and leaks over many checkpoint/restore generations of one JVM.
+#
+# Usage: soak.sh [-c CYCLES] [-l LOAD_SECONDS] [-o OUT.csv]
+#   CYCLES        checkpoint/restore cycles (default: 1000)
+#   LOAD_SECONDS  load to put on every generation before its checkpoint
+#                 (default: 1)
+#
+# The Workload is checkpointed with jcmd and restored from the image, and
+# the restored JVM is checkpointed again, and so on. CRaCCheckpointTo is a
+# symlink that is switched between two image directories, so a generation
+# is always restored from a complete image while the next one is written.
+# CRIU restores the JVM with its original pid, so it is sampled at the
+# same pid every cycle.
+#
+# Writes per cycle: dump and restore time and image size from the engine
+# metrics, and RSS, mappings, open fds and metaspace of the restored JVM
+# to OUT.csv. A Mann-Kendall test over the cycles goes to OUT-trend.csv and
+# flags metrics that keep growing (or shrinking). With gnuplot, the series
+# are drawn to OUT.png.
+
+. "$(dirname "$0")/common.sh"
+
+cycles=1000
+load=1
+out=soak.csv
+while getopts "c:l:o:" opt; do
+    case $opt in
+        c) cycles=$OPTARG ;;
+        l) load=$OPTARG ;;
+        o) out=$OPTARG ;;
+        *) die "usage: soak.sh [-c CYCLES] [-l LOAD_SECONDS] [-o OUT.csv]" ;;
+    esac
+done
+
+work=$BENCH_WORK/soak
+rm -rf "$work"
+mkdir -p "$work/A" "$work/B" "$work/ports"
+ln -s A "$work/current"
+export CRAC_ENGINE_METRICS=$work/metrics
+
+ports() {
+    ls "$work/ports" | grep -c '^port-[0-9]*$'
+}
+
+# Waits for the number of announced ports to exceed $1
+wait_port() {
+    for i in $(seq 1 600); do
+        [ "$(ports)" -gt "$1" ] && return 0
+        sleep 0.1
+    done
+    return 1
+}
+
+"$JAVA" $JAVA_OPTS -XX:CRaCCheckpointTo="$work/current" -cp "$BENCH_JAR" cracbench.Workload \
+    --port-dir "$work/ports" --warmup 20000 > "$work/jvm.log" 2>&1 &
+launcher=$!
+jvm=$launcher
+wait_port 0 || die "Workload did not start, see $work/jvm.log"
+
+echo "cycle,dump_ms,restore_ms,image_mb,rss_mb,maps,fds,metaspace_kb" > "$out"
+for cycle in $(seq 1 "$cycles"); do
+    if [ "$load" -gt 0 ]; then
+        "$JAVA" -cp "$BENCH_JAR" cracbench.LoadGen --port-dir "$work/ports" --duration "$load" > /dev/null
+    fi
+
+    # Write the next image into the directory not restored from
+    next=$([ "$(readlink "$work/current")" = A ] && echo B || echo A)
+    rm -rf "${work:?}/$next"
+    mkdir "$work/$next"
+    ln -sfn "$next" "$work/current"
+
+    since=$(records "$CRAC_ENGINE_METRICS")
+    "$JCMD" "$jvm" JDK.checkpoint >> "$work/jcmd.log" 2>&1
+    wait "$launcher" 2>/dev/null
+    [ -f "$work/$next/inventory.img" ] || die "checkpoint $cycle failed, see $work/jvm.log"
+
+    before=$(ports)
+    "$JAVA" -XX:CRaCRestoreFrom="$work/current" >> "$work/jvm.log" 2>&1 &
+    launcher=$!
+    wait_port "$before" || die "restore $cycle failed, see $work/jvm.log"
+
+    rss=$(awk '/^VmRSS:/ { printf "%.1f", $2 / 1024 }' "/proc/$jvm/status")
+    maps=$(wc -l < "/proc/$jvm/maps")
+    fds=$(ls "/proc/$jvm/fd" | wc -l)
+    metaspace=$("$JCMD" "$jvm" GC.heap_info 2>/dev/null | sed -n 's/^ *Metaspace *used \([0-9]*\)K.*/\1/p')
+    awk -v c="$cycle" -v d="$(metric "$CRAC_ENGINE_METRICS" checkpoint duration_ns "$since")" \
+        -v r="$(metric "$CRAC_ENGINE_METRICS" restore duration_ns "$since")" \
+        -v b="$(metric "$CRAC_ENGINE_METRICS" checkpoint image_bytes "$since")" \
+        -v rss="${rss:-NA}" -v maps="$maps" -v fds="$fds" -v m="${metaspace:-NA}" '
+        function scaled(v, d) { return v == "NA" ? "NA" : sprintf("%.1f", v / d) }
+        BEGIN { printf "%s,%s,%s,%s,%s,%s,%s,%s\n", c, scaled(d, 1e6), scaled(r, 1e6), scaled(b, 1048576), rss, maps, fds, m }' \
+        >> "$out"
+    [ $((cycle % 50)) = 0 ] && echo "cycle $cycle: $(tail -1 "$out")" >&2
+done
+kill "$launcher" 2>/dev/null
+wait "$launcher" 2>/dev/null
+
+# Mann-Kendall: S counts increasing minus decreasing pairs of cycles, |Z| > 3
+# is a trend that noise does not explain. The slope is a least squares fit,
+# per 100 cycles.
+trend=${out%.csv}-trend.csv
+echo "metric,n,s,z,slope_per_100,trend" > "$trend"
+for col in 2:dump_ms 3:restore_ms 4:image_mb 5:rss_mb 6:maps 7:fds 8:metaspace_kb; do
+    awk -F, -v c="${col%%:*}" -v name="${col#*:}" '
+        NR > 1 && $c != "NA" {
+            x[++n] = $1; y[n] = $c
+            sx += $1; sy += $c; sxx += $1 * $1; sxy += $1 * $c
+        }
+        END {
+            if (n < 3) { printf "%s,%d,NA,NA,NA,NA\n", name, n; exit }
+            s = 0
+            for (i = 1; i < n; ++i) {
+                for (j = i + 1; j <= n; ++j) {
+                    d = y[j] - y[i]
+                    s += d > 0 ? 1 : d < 0 ? -1 : 0
+                }
+            }
+            var = n * (n - 1) * (2 * n + 5) / 18
+            z = s > 0 ? (s - 1) / sqrt(var) : s < 0 ? (s + 1) / sqrt(var) : 0
+            slope = (n * sxy - sx * sy) / (n * sxx - sx * sx)
+            printf "%s,%d,%d,%.2f,%.4g,%s\n", name, n, s, z, slope * 100,
+                (z > 3 ? "increasing" : z < -3 ? "decreasing" : "none")
+        }' "$out" >> "$trend"
+done
+
+if command -v gnuplot > /dev/null; then
+    gnuplot <<GP
+set terminal png size 1200,1400
+set output "${out%.csv}.png"
+set datafile separator ","
+set multiplot layout 4,2
+set xlabel "cycle"
+plot "$out" using 1:2 with lines title "dump ms"
+plot "$out" using 1:3 with lines title "restore ms"
+plot "$out" using 1:4 with lines title "image MB"
+plot "$out" using 1:5 with lines title "RSS MB"
+plot "$out" using 1:6 with lines title "mappings"
+plot "$out" using 1:7 with lines title "open fds"
+plot "$out" using 1:8 with lines title "metaspace KB"
+unset multiplot
+GP
+fi
+cat "$trend"
@@ -0,0 +1,75 @@
+#!/bin/bash
+#
+# Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+# DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+#
+# This code is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 only, as
+# published by the Free Software Foundation.
+#
+# This code is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# version 2 for more details (a copy is included in the LICENSE file that
+# accompanied this code).
+#
+# You should have received a copy of the GNU General Public License version
+# 2 along with this work; if not, write to the Free Software Foundation,
+# Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+# Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+# CA 94089 USA or visit www.azul.com if you need additional information or
+# have any questions.
+#
+
+# Time to first request: a cold start of the Workload against restoring it
+# through the engine in every restore mode.
+#
+# Usage: startup.sh [-n ITERATIONS] [-m "MODES"] [-o OUT.csv]
+#
+# Writes a row per iteration to OUT.csv and the latency distribution per
+# mode to OUT-summary.csv. Latencies are in milliseconds from the launch of
+# java to the announcement of the port (ready) and to the first response.
+
+. "$(dirname "$0")/common.sh"
+
+iterations=10
+modes="cold $RESTORE_MODES"
+out=startup.csv
+while getopts "n:m:o:" opt; do
+    case $opt in
+        n) iterations=$OPTARG ;;
+        m) modes=$OPTARG ;;
+        o) out=$OPTARG ;;
+        *) die "usage: startup.sh [-n ITERATIONS] [-m MODES] [-o OUT.csv]" ;;
+    esac
+done
+
+mkdir -p "$BENCH_WORK"
+echo "mode,iteration,ready_ms,first_response_ms" > "$out"
+
+for mode in $modes; do
+    portdir=$BENCH_WORK/startup-$mode.ports
+    if [ "$mode" = cold ]; then
+        cmd=("$JAVA" -cp "$BENCH_JAR" cracbench.Workload --port-dir "$portdir")
+    else
+        make_image "$mode" "$BENCH_WORK/startup-$mode" "$portdir"
+        cmd=(env $(mode_env "$mode") "$JAVA" -XX:CRaCRestoreFrom="$BENCH_WORK/startup-$mode")
+    fi
+    for i in $(seq 1 "$iterations"); do
+        read -r ready first < <(probe "$portdir" "${cmd[@]}")
+        echo "$mode,$i,${ready:-NA},${first:-NA}" >> "$out"
+        echo "$mode #$i: ready ${ready:-NA} ms, first response ${first:-NA} ms" >&2
+    done
+done
+
+summary=${out%.csv}-summary.csv
+echo "mode,metric,n,mean,p50,p90,p99,max" > "$summary"
+for mode in $modes; do
+    for col in 3:ready_ms 4:first_response_ms; do
+        awk -F, -v m="$mode" -v c="${col%%:*}" 'NR > 1 && $1 == m && $c != "NA" { print $c }' "$out" \
+            | distribution | awk -v m="$mode" -v n="${col#*:}" '{ OFS = ","; print m, n, $1, $2, $3, $4, $5, $6 }' \
+            >> "$summary"
+    done
+done
+cat "$summary"
@@ -0,0 +1,162 @@
+#!/bin/bash
+#
+# Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+# DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+#
+# This code is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 only, as
+# published by the Free Software Foundation.
+#
+# This code is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# version 2 for more details (a copy is included in the LICENSE file that
+# accompanied this code).
+#
+# You should have received a copy of the GNU General Public License version
+# 2 along with this work; if not, write to the Free Software Foundation,
+# Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+# Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+# CA 94089 USA or visit www.azul.com if you need additional information or
+# have any questions.
+
+# Dump and restore times against the storage the image lives on.
+#
+# Usage: storage.sh [-n ITERATIONS] [-b "BACKENDS"] [-s LOOP_SIZE] [-o OUT.csv]
+#   BACKENDS    any of: local shm tmpfs ext4 xfs overlay
+#               (default: all that can be set up here)
+#   LOOP_SIZE   size of the loop-mounted file systems (default: 4G)
+#
+# local is a directory in BENCH_WORK and shm is /dev/shm. The others are
+# mounted for the run and need root: a fresh tmpfs, ext4 and xfs on loop
+# devices backed by sparse files in BENCH_WORK, and an overlay whose upper
+# layer is in BENCH_WORK, as a container's writable layer would be.
+#
+# Every iteration checkpoints the Workload onto the backend and restores
+# it twice: with the image still in the page cache (warm), and after the
+# image was written back and dropped from it (cold). CRIU has no direct I/O
+# mode, so cold is what an image that was not just written looks like.
+# Writes a row per restore to OUT.csv and the distributions per backend to
+# OUT-summary.csv.
+
+. "$(dirname "$0")/common.sh"
+
+iterations=5
+backends=
+loop_size=4G
+out=storage.csv
+while getopts "n:b:s:o:" opt; do
+    case $opt in
+        n) iterations=$OPTARG ;;
+        b) backends=$OPTARG ;;
+        s) loop_size=$OPTARG ;;
+        o) out=$OPTARG ;;
+        *) die "usage: storage.sh [-n ITERATIONS] [-b BACKENDS] [-s LOOP_SIZE] [-o OUT.csv]" ;;
+    esac
+done
+
+IMGSTAT=$BENCH_DIR/dist/imgstat
+[ -x "$IMGSTAT" ] || die "$IMGSTAT not found, run make first"
+
+mkdir -p "$BENCH_WORK/storage"
+export CRAC_ENGINE_METRICS=$BENCH_WORK/storage.metrics
+rm -f "$CRAC_ENGINE_METRICS"
+
+mounts=()
+loops=()
+cleanup() {
+    for m in "${mounts[@]}"; do
+        umount "$m" 2>/dev/null
+    done
+    rmdir /dev/shm/crac-storage 2>/dev/null
+    for l in "${loops[@]}"; do
+        losetup -d "$l" 2>/dev/null
+    done
+}
+trap cleanup EXIT
+
+# Prepares a backend and prints the directory to put images in
+setup() {
+    local name=$1 mnt=$BENCH_WORK/storage/$1
+    case $name in
+        local) mkdir -p "$mnt" && echo "$mnt"; return ;;
+        shm)   [ -d /dev/shm ] && mkdir -p /dev/shm/crac-storage && echo /dev/shm/crac-storage; return ;;
+    esac
+    [ "$(id -u)" = 0 ] || return 1
+    mkdir -p "$mnt"
+    case $name in
+        tmpfs)
+            mount -t tmpfs -o size="$loop_size" tmpfs "$mnt" || return 1
+            ;;
+        ext4|xfs)
+            command -v "mkfs.$name" > /dev/null || return 1
+            local file=$BENCH_WORK/storage/$name.img dev
+            rm -f "$file"
+            truncate -s "$loop_size" "$file"
+            dev=$(losetup -f --show "$file") || return 1
+            loops+=("$dev")
+            "mkfs.$name" -q "$dev" > /dev/null 2>&1 || "mkfs.$name" "$dev" > /dev/null 2>&1 || return 1
+            mount "$dev" "$mnt" || return 1
+            ;;
+        overlay)
+            local base=$BENCH_WORK/storage/overlay-layers
+            mkdir -p "$base/lower" "$base/upper" "$base/work"
+            mount -t overlay overlay -o lowerdir="$base/lower",upperdir="$base/upper",workdir="$base/work" "$mnt" \
+                || return 1
+            ;;
+        *)
+            return 1
+            ;;
+    esac
+    mounts+=("$mnt")
+    echo "$mnt"
+}
+
+if [ -z "$backends" ]; then
+    backends="local shm"
+    [ "$(id -u)" = 0 ] && backends="$backends tmpfs ext4 xfs overlay"
+fi
+
+echo "backend,fs,iteration,cache,image_mb,dump_ms,dump_mb_s,restore_ms,restore_mb_s,first_response_ms" > "$out"
+for backend in $backends; do
+    # Not in a subshell, setup records what to clean up
+    setup "$backend" > "$BENCH_WORK/storage/dir" || { echo "backend $backend not available, skipped" >&2; continue; }
+    dir=$(cat "$BENCH_WORK/storage/dir")
+    fs=$(stat -f -c %T "$dir")
+    image=$dir/image
+    portdir=$BENCH_WORK/storage.ports
+    for i in $(seq 1 "$iterations"); do
+        since=$(records "$CRAC_ENGINE_METRICS")
+        (make_image restore "$image" "$portdir") || continue
+        dump_ns=$(metric "$CRAC_ENGINE_METRICS" checkpoint duration_ns "$since")
+        image_bytes=$(metric "$CRAC_ENGINE_METRICS" checkpoint image_bytes "$since")
+        for cache in warm cold; do
+            [ "$cache" = cold ] && "$IMGSTAT" evict "$image"
+            since=$(records "$CRAC_ENGINE_METRICS")
+            read -r ready first < <(probe "$portdir" "$JAVA" -XX:CRaCRestoreFrom="$image")
+            restore_ns=$(metric "$CRAC_ENGINE_METRICS" restore duration_ns "$since")
+            awk -v b="$backend" -v f="$fs" -v i="$i" -v c="$cache" -v s="$image_bytes" \
+                -v d="$dump_ns" -v r="$restore_ns" -v p="${first:-NA}" '
+                function ms(ns) { return ns == "NA" ? "NA" : sprintf("%.1f", ns / 1e6) }
+                function rate(ns) { return ns == "NA" || ns == 0 ? "NA" : sprintf("%.1f", s / 1048576 / (ns / 1e9)) }
+                BEGIN {
+                    printf "%s,%s,%s,%s,%.1f,%s,%s,%s,%s,%s\n", b, f, i, c, s / 1048576,
+                        ms(d), rate(d), ms(r), rate(r), p
+                }' >> "$out"
+            tail -1 "$out" >&2
+        done
+        rm -rf "$image"
+    done
+done
+
+summary=${out%.csv}-summary.csv
+echo "backend,cache,metric,n,mean,p50,p90,p99,max" > "$summary"
+for key in $(awk -F, 'NR > 1 { print $1 "," $4 }' "$out" | sort -u); do
+    for col in 6:dump_ms 8:restore_ms 10:first_response_ms; do
+        awk -F, -v k="$key" -v c="${col%%:*}" 'NR > 1 && $1 "," $4 == k && $c != "NA" { print $c }' "$out" \
+            | distribution | awk -v k="$key" -v n="${col#*:}" '{ OFS = ","; print k, n, $1, $2, $3, $4, $5, $6 }' \
+            >> "$summary"
+    done
+done
+cat "$summary"
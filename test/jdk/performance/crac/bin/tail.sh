@@ -0,0 +1,154 @@
+#!/bin/bash
+#
+# Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+# DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+#
+# This code is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 only, as
+# published by the Free Software Foundation.
+#
+# This code is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# version 2 for more details (a copy is included in the LICENSE file that
+# accompanied this code).
+#
+# You should have received a copy of the GNU General Public License version
+# 2 along with this work; if not, write to the Free Software Foundation,
+# Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+# Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+# CA 94089 USA or visit www.azul.com if you need additional information or
+# have any questions.
+
+# Latency of live traffic around checkpoints that leave the JVM running.
+#
+# Usage: tail.sh [-m "MODES"] [-c CHECKPOINTS] [-i INTERVAL] [-r RATE] [-w WINDOW] [-o OUT.csv]
+#   MODES        engine modes to compare, see mode_env (default: restore verify encrypted)
+#   CHECKPOINTS  checkpoints per mode (default: 5)
+#   INTERVAL     seconds between checkpoints (default: 20)
+#   RATE         requests per second of the load (default: 500)
+#   WINDOW       seconds before and after a checkpoint to compare with (default: 5)
+#
+# The Workload runs with CRAC_CRIU_LEAVE_RUNNING and is checkpointed with
+# jcmd while LoadGen sends it requests at a fixed rate. Latencies are taken
+# from when a request was due, so requests held up by the checkpoint count
+# with all of their wait. Each request falls into a phase by its due time:
+# during a checkpoint, from the Workload's beforeCheckpoint to its
+# afterRestore; before or after, within WINDOW of one; or steady.
+#
+# Writes latency percentiles per mode, checkpoint and phase to OUT.csv, with
+# rows for all checkpoints together marked "all", and latency histograms
+# per mode and phase to OUT-histogram.csv.
+
+. "$(dirname "$0")/common.sh"
+
+modes="restore verify encrypted"
+checkpoints=5
+interval=20
+rate=500
+window=5
+out=tail.csv
+while getopts "m:c:i:r:w:o:" opt; do
+    case $opt in
+        m) modes=$OPTARG ;;
+        c) checkpoints=$OPTARG ;;
+        i) interval=$OPTARG ;;
+        r) rate=$OPTARG ;;
+        w) window=$OPTARG ;;
+        o) out=$OPTARG ;;
+        *) die "usage: tail.sh [-m MODES] [-c CHECKPOINTS] [-i INTERVAL] [-r RATE] [-w WINDOW] [-o OUT.csv]" ;;
+    esac
+done
+
+mkdir -p "$BENCH_WORK"
+[ -f "$BENCH_WORK/image.key" ] || head -c 32 /dev/urandom > "$BENCH_WORK/image.key"
+samples=$BENCH_WORK/tail.samples
+rm -f "$samples"
+
+for mode in $modes; do
+    image=$BENCH_WORK/tail-$mode
+    portdir=$BENCH_WORK/tail-$mode.ports
+    events=$BENCH_WORK/tail-$mode.events
+    latencies=$BENCH_WORK/tail-$mode.latencies
+    rm -rf "$image" "$portdir" "$events"
+    mkdir -p "$image" "$portdir"
+
+    env $(mode_env "$mode") CRAC_CRIU_LEAVE_RUNNING=1 "$JAVA" $JAVA_OPTS -XX:CRaCCheckpointTo="$image" \
+        -cp "$BENCH_JAR" cracbench.Workload --port-dir "$portdir" --warmup 20000 --events "$events" \
+        > "$image.log" 2>&1 &
+    pid=$!
+    duration=$((interval * (checkpoints + 1)))
+    "$JAVA" -cp "$BENCH_JAR" cracbench.LoadGen --port-dir "$portdir" --rate "$rate" --connections 16 \
+        --duration "$duration" --latencies "$latencies" > "$image.load" &
+    load=$!
+
+    # The first interval is the steady state to compare with
+    for i in $(seq 1 "$checkpoints"); do
+        sleep "$interval"
+        "$JCMD" "$pid" JDK.checkpoint >> "$image.log" 2>&1 || echo "$mode: checkpoint $i failed" >&2
+    done
+    wait "$load"
+    kill "$pid" 2>/dev/null
+    wait "$pid" 2>/dev/null
+    echo "$mode: $(cat "$image.load")" >&2
+
+    # Phase of every request as "MODE CHECKPOINT PHASE LATENCY_MS". The events
+    # are told apart by file name: with no checkpoint events, FNR == NR would
+    # hold for the samples too. A JVM that never checkpointed may not have
+    # written the file at all.
+    touch "$events"
+    awk -v mode="$mode" -v w="$window" '
+        FILENAME == ARGV[1] {
+            if ($1 == "checkpoint_start") s[++n] = $2; else if ($1 == "checkpoint_end") e[n] = $2
+            next
+        }
+        {
+            phase = "steady"; cp = 0
+            for (i = 1; i <= n; ++i) {
+                end = i in e ? e[i] : s[i] + 3600e9
+                if ($1 >= s[i] && $1 <= end) { phase = "during"; cp = i; break }
+                if ($1 >= s[i] - w * 1e9 && $1 < s[i]) { phase = "before"; cp = i }
+                if ($1 > end && $1 <= end + w * 1e9) { phase = "after"; cp = i }
+            }
+            printf "%s %s %s %.3f\n", mode, cp, phase, $2 / 1e6
+        }' "$events" "$latencies" >> "$samples"
+done
+
+# Percentiles per mode, checkpoint and phase, and per mode and phase as "all"
+percentiles() {
+    sort -k1,1 -k2,2 -k3,3 -k4,4g | awk '
+        function flush() {
+            if (!c) return
+            split(key, k, SUBSEP)
+            printf "%s,%s,%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f\n", k[1], k[2], k[3], c,
+                v[int(0.5 * c + 0.999999)], v[int(0.9 * c + 0.999999)], v[int(0.99 * c + 0.999999)],
+                v[int(0.999 * c + 0.999999)], v[c]
+            c = 0
+        }
+        { if (($1 SUBSEP $2 SUBSEP $3) != key) { flush(); key = $1 SUBSEP $2 SUBSEP $3 } v[++c] = $4 }
+        END { flush() }'
+}
+echo "mode,checkpoint,phase,n,p50_ms,p90_ms,p99_ms,p999_ms,max_ms" > "$out"
+{
+    awk '$2 != 0' "$samples" | percentiles
+    awk '{ $2 = "all"; print }' "$samples" | percentiles
+} >> "$out"
+
+histogram=${out%.csv}-histogram.csv
+echo "mode,phase,le_ms,count" > "$histogram"
+awk '
+    BEGIN { for (b = 0.125; b <= 16384; b *= 2) bounds[++nb] = b }
+    {
+        key = $1 "," $3
+        for (i = 1; i <= nb && $4 > bounds[i]; ++i);
+        h[key, i]++; keys[key] = 1
+    }
+    END {
+        for (key in keys) {
+            for (i = 1; i <= nb + 1; ++i) {
+                printf "%s,%s,%d\n", key, i <= nb ? bounds[i] : "+Inf", h[key, i]
+            }
+        }
+    }' "$samples" | sort -t, -k1,1 -k2,2 -k3,3g >> "$histogram"
+cat "$out"
@@ -0,0 +1,79 @@
+#!/bin/bash
+#
+# Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+# DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+#
+# This code is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 only, as
+# published by the Free Software Foundation.
+#
+# This code is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# version 2 for more details (a copy is included in the LICENSE file that
+# accompanied this code).
+#
+# You should have received a copy of the GNU General Public License version
+# 2 along with this work; if not, write to the Free Software Foundation,
+# Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+# Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+# CA 94089 USA or visit www.azul.com if you need additional information or
+# have any questions.
+
+# Overhead of image verification on restore: one image with checksums is
+# restored alternately with verification off (CRAC_IMAGE_VERIFY=false) and
+# on, and the restore latencies the engine records are compared.
+#
+# Usage: verify.sh [-n ITERATIONS] [-x MAX_PCT] [-o OUT.csv]
+#
+# Writes a row per restore to OUT.csv: the restore latency and the time
+# post-resume waited for the verifier, in milliseconds. Prints the median
+# latency with and without verification and fails if verification adds more
+# than MAX_PCT percent (default 5).
+
+. "$(dirname "$0")/common.sh"
+
+iterations=10
+max_pct=5
+out=verify.csv
+while getopts "n:x:o:" opt; do
+    case $opt in
+        n) iterations=$OPTARG ;;
+        x) max_pct=$OPTARG ;;
+        o) out=$OPTARG ;;
+        *) die "usage: verify.sh [-n ITERATIONS] [-x MAX_PCT] [-o OUT.csv]" ;;
+    esac
+done
+
+mkdir -p "$BENCH_WORK"
+export CRAC_ENGINE_METRICS=$BENCH_WORK/verify.metrics
+rm -f "$CRAC_ENGINE_METRICS"
+image=$BENCH_WORK/verify
+portdir=$BENCH_WORK/verify.ports
+make_image verify "$image" "$portdir"
+
+echo "verify,iteration,restore_ms,verify_wait_ms" > "$out"
+for i in $(seq 1 "$iterations"); do
+    for verify in false true; do
+        since=$(records "$CRAC_ENGINE_METRICS")
+        probe "$portdir" env CRAC_IMAGE_VERIFY=$verify "$JAVA" -XX:CRaCRestoreFrom="$image" > /dev/null
+        awk -v v="$verify" -v i="$i" -v r="$(metric "$CRAC_ENGINE_METRICS" restore duration_ns "$since")" \
+            -v w="$(metric "$CRAC_ENGINE_METRICS" restore verify_wait_ns "$since")" '
+            function ms(ns) { return ns == "NA" ? "NA" : sprintf("%.1f", ns / 1e6) }
+            BEGIN { printf "%s,%s,%s,%s\n", v, i, ms(r), ms(w) }' >> "$out"
+        echo "verify=$verify #$i: $(tail -1 "$out" | cut -d, -f3) ms" >&2
+    done
+done
+
+p50() {
+    awk -F, -v v="$1" 'NR > 1 && $1 == v && $3 != "NA" { print $3 }' "$out" | distribution | cut -d' ' -f3
+}
+plain=$(p50 false)
+verified=$(p50 true)
+[ "$plain" != NA ] && [ "$verified" != NA ] || die "no successful restores to compare, see $out"
+awk -v p="$plain" -v v="$verified" -v max="$max_pct" 'BEGIN {
+    pct = 100 * (v - p) / p
+    printf "restore p50 %.1f ms, with verification %.1f ms: %+.1f%% (limit %s%%)\n", p, v, pct, max
+    exit pct > max
+}' || die "verification overhead above ${max_pct}%, see $out"
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+ * CA 94089 USA or visit www.azul.com if you need additional information or
+ * have any questions.
+ */
+
+package cracbench;
+
+import java.io.BufferedWriter;
+import java.io.IOException;
+import java.io.InputStream;
+import java.net.HttpURLConnection;
+import java.net.URL;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.time.Instant;
+import java.util.Arrays;
+import java.util.ArrayList;
+import java.util.List;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.atomic.AtomicLong;
+import java.util.concurrent.locks.LockSupport;
+
+/**
+ * Drives a running {@link Workload} with requests from a fixed number of
+ * connections and reports the throughput.
+ *
+ * Waits for the port to be announced in the port directory, so it can be
+ * started together with the instance to measure, then sends requests for
+ * the given duration. Prints "requests=N errors=E rps=R".
+ *
+ * By default every connection sends its next request as soon as the last
+ * one completed. With --rate, requests are due at fixed intervals instead
+ * and a failed request is retried until it succeeds; the latency is taken
+ * from the time the request was due, so a stalled service is charged for
+ * all the requests it held up. --latencies writes "DUE_NS LATENCY_NS" per
+ * completed request, the due time in CLOCK_REALTIME nanoseconds.
+ *
+ * Usage: LoadGen --port-dir DIR [--duration SECONDS] [--connections N] [--timeout SECONDS]
+ *                [--rate REQUESTS_PER_SECOND] [--latencies FILE]
+ */
+public class LoadGen {
+
+    static class Samples {
+        long[] data = new long[2 * 4096];
+        int size;
+
+        void add(long due, long latency) {
+            if (size + 2 > data.length) {
+                data = Arrays.copyOf(data, data.length * 2);
+            }
+            data[size++] = due;
+            data[size++] = latency;
+        }
+    }
+
+    static boolean request(int port, long seq) {
+        try {
+            HttpURLConnection c = (HttpURLConnection) new URL("http://127.0.0.1:" + port + "/load/" + seq).openConnection();
+            c.setConnectTimeout(1000);
+            c.setReadTimeout(10000);
+            try (InputStream in = c.getInputStream()) {
+                in.readAllBytes();
+            }
+            return c.getResponseCode() == 200;
+        } catch (IOException e) {
+            return false;
+        }
+    }
+
+    public static void main(String[] args) throws Exception {
+        Path portDir = null;
+        long duration = 60;
+        int connections = 4;
+        long timeout = 60;
+        double rate = 0;
+        Path latencies = null;
+        for (int i = 0; i < args.length; ++i) {
+            switch (args[i]) {
+                case "--port-dir": portDir = Paths.get(args[++i]); break;
+                case "--duration": duration = Long.parseLong(args[++i]); break;
+                case "--connections": connections = Integer.parseInt(args[++i]); break;
+                case "--timeout": timeout = Long.parseLong(args[++i]); break;
+                case "--rate": rate = Double.parseDouble(args[++i]); break;
+                case "--latencies": latencies = Paths.get(args[++i]); break;
+                default: throw new IllegalArgumentException("Unknown option " + args[i]);
+            }
+        }
+        if (portDir == null) {
+            throw new IllegalArgumentException("--port-dir is required");
+        }
+
+        long deadline = System.nanoTime() + TimeUnit.SECONDS.toNanos(timeout);
+        int port;
+        while ((port = Probe.port(portDir)) < 0) {
+            if (System.nanoTime() > deadline) {
+                System.out.println("error=timeout");
+                System.exit(1);
+            }
+            Thread.sleep(1);
+        }
+
+        final int target = port;
+        final int n = connections;
+        final double interval = rate > 0 ? 1e9 / rate : 0;
+        final long retryNs = TimeUnit.SECONDS.toNanos(timeout);
+        AtomicLong requests = new AtomicLong();
+        AtomicLong errors = new AtomicLong();
+        Instant now = Instant.now();
+        long start = System.nanoTime();
+        long realStart = now.getEpochSecond() * 1_000_000_000L + now.getNano();
+        long end = start + TimeUnit.SECONDS.toNanos(duration);
+        List<Thread> threads = new ArrayList<>();
+        List<Samples> samples = new ArrayList<>();
+        for (int t = 0; t < connections; ++t) {
+            final int first = t;
+            Samples mine = new Samples();
+            samples.add(mine);
+            Thread thread = new Thread(() -> {
+                for (long seq = first; ; seq += n) {
+                    long due = interval > 0 ? start + (long) (seq * interval) : System.nanoTime();
+                    if (due >= end) {
+                        break;
+                    }
+                    long wait;
+                    while ((wait = due - System.nanoTime()) > 0) {
+                        LockSupport.parkNanos(wait);
+                    }
+                    // Retried while the server is away; one error per request that never succeeds
+                    boolean ok;
+                    while (!(ok = request(target, seq)) && interval > 0 && System.nanoTime() < due + retryNs) {
+                        LockSupport.parkNanos(1_000_000);
+                    }
+                    if (ok) {
+                        requests.incrementAndGet();
+                        mine.add(realStart + (due - start), System.nanoTime() - due);
+                    } else {
+                        errors.incrementAndGet();
+                    }
+                }
+            });
+            thread.start();
+            threads.add(thread);
+        }
+        for (Thread thread : threads) {
+            thread.join();
+        }
+        if (latencies != null) {
+            try (BufferedWriter out = Files.newBufferedWriter(latencies)) {
+                for (Samples m : samples) {
+                    for (int i = 0; i < m.size; i += 2) {
+                        out.write(m.data[i] + " " + m.data[i + 1] + "\n");
+                    }
+                }
+            }
+        }
+        double seconds = (System.nanoTime() - start) / 1e9;
+        System.out.printf("requests=%d errors=%d rps=%.1f%n", requests.get(), errors.get(),
+                requests.get() / seconds);
+    }
+}
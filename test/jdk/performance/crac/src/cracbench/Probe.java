@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+ * CA 94089 USA or visit www.azul.com if you need additional information or
+ * have any questions.
+ */
+
+package cracbench;
+
+import java.io.IOException;
+import java.io.InputStream;
+import java.net.HttpURLConnection;
+import java.net.URL;
+import java.nio.file.DirectoryStream;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.util.ArrayList;
+import java.util.List;
+import java.util.concurrent.TimeUnit;
+
+/**
+ * Launches a command and measures how long it takes to serve its first
+ * HTTP request.
+ *
+ * The port is taken from the first file appearing in the port directory
+ * (see {@link Workload}). The directory is emptied before the command is
+ * started. Prints "ready_ms=R first_response_ms=F", where R is the time
+ * until the port was announced and F the time until the first 200 response,
+ * both from the launch of the command. The command is terminated afterwards
+ * unless --keep is given, in which case its pid is printed too.
+ *
+ * Usage: Probe --port-dir DIR [--timeout SECONDS] [--keep] -- COMMAND...
+ */
+public class Probe {
+
+    static void clean(Path dir) throws IOException {
+        Files.createDirectories(dir);
+        try (DirectoryStream<Path> ds = Files.newDirectoryStream(dir)) {
+            for (Path p : ds) {
+                Files.deleteIfExists(p);
+            }
+        }
+    }
+
+    static int port(Path dir) throws IOException {
+        try (DirectoryStream<Path> ds = Files.newDirectoryStream(dir, "port-*[0-9]")) {
+            for (Path p : ds) {
+                return Integer.parseInt(Files.readString(p).trim());
+            }
+        }
+        return -1;
+    }
+
+    static boolean respond(int port) {
+        try {
+            HttpURLConnection c = (HttpURLConnection) new URL("http://127.0.0.1:" + port + "/probe").openConnection();
+            c.setConnectTimeout(1000);
+            c.setReadTimeout(10000);
+            try (InputStream in = c.getInputStream()) {
+                in.readAllBytes();
+            }
+            return c.getResponseCode() == 200;
+        } catch (IOException e) {
+            return false;
+        }
+    }
+
+    public static void main(String[] args) throws Exception {
+        Path portDir = null;
+        long timeout = 60;
+        boolean keep = false;
+        List<String> command = new ArrayList<>();
+        for (int i = 0; i < args.length; ++i) {
+            if (args[i].equals("--")) {
+                for (++i; i < args.length; ++i) {
+                    command.add(args[i]);
+                }
+            } else if (args[i].equals("--port-dir")) {
+                portDir = Paths.get(args[++i]);
+            } else if (args[i].equals("--timeout")) {
+                timeout = Long.parseLong(args[++i]);
+            } else if (args[i].equals("--keep")) {
+                keep = true;
+            } else {
+                throw new IllegalArgumentException("Unknown option " + args[i]);
+            }
+        }
+        if (portDir == null || command.isEmpty()) {
+            throw new IllegalArgumentException("Usage: Probe --port-dir DIR [--timeout SECONDS] [--keep] -- COMMAND...");
+        }
+        clean(portDir);
+
+        // Warm up the client side so that it does not count against the command
+        respond(1);
+
+        long deadline = System.nanoTime() + TimeUnit.SECONDS.toNanos(timeout);
+        long start = System.nanoTime();
+        Process process = new ProcessBuilder(command).inheritIO().start();
+
+        int port = -1;
+        long ready = -1;
+        long first = -1;
+        while (System.nanoTime() < deadline && process.isAlive()) {
+            if (port < 0) {
+                port = port(portDir);
+                if (port < 0) {
+                    Thread.sleep(0, 200_000);
+                    continue;
+                }
+                ready = System.nanoTime() - start;
+            }
+            if (respond(port)) {
+                first = System.nanoTime() - start;
+                break;
+            }
+            Thread.sleep(0, 200_000);
+        }
+
+        if (first < 0) {
+            System.out.println("error=" + (process.isAlive() ? "timeout" : "exit" + process.exitValue()));
+        } else {
+            System.out.printf("ready_ms=%.3f first_response_ms=%.3f%s%n", ready / 1e6, first / 1e6,
+                    keep ? " pid=" + process.pid() : "");
+        }
+        if (!keep || first < 0) {
+            process.destroy();
+            if (!process.waitFor(10, TimeUnit.SECONDS)) {
+                process.descendants().forEach(ProcessHandle::destroyForcibly);
+                process.destroyForcibly();
+            }
+        }
+        System.exit(first < 0 ? 1 : 0);
+    }
+}
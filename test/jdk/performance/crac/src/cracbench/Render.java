@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+ * CA 94089 USA or visit www.azul.com if you need additional information or
+ * have any questions.
+ */
+
+package cracbench;
+
+import java.awt.AlphaComposite;
+import java.awt.BasicStroke;
+import java.awt.Color;
+import java.awt.Font;
+import java.awt.GradientPaint;
+import java.awt.Graphics2D;
+import java.awt.RenderingHints;
+import java.awt.geom.AffineTransform;
+import java.awt.geom.Ellipse2D;
+import java.awt.geom.Path2D;
+import java.awt.image.BufferedImage;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.time.Instant;
+import java.util.Arrays;
+
+import jdk.crac.Core;
+
+/**
+ * Renders a Java2D scene in a loop and reports frame times, to see how
+ * much of the pipelines' warm-up a restored JVM keeps.
+ *
+ * A frame exercises what RenderPerfTest measures one by one: filled and
+ * antialiased shapes, wide strokes, gradients, alpha compositing, scaled
+ * and rotated images and antialiased text, into an offscreen BufferedImage.
+ * There is no window target: AWT keeps its connection to the X server for
+ * the life of the toolkit, and a checkpoint cannot take it along.
+ *
+ * After the warm-up, and after restore with --checkpoint, frames are
+ * rendered for the measured period and "first_frame_ms=F
+ * first_second_frames=N p50_ms= p99_ms= max_ms= fps= start_ns=S" is
+ * written to the output file. Times are from the start of the measured
+ * period, which is at S in CLOCK_REALTIME nanoseconds.
+ *
+ * Options:
+ *   --out FILE         where to write the result (required)
+ *   --warmup SECONDS   render for this long before measuring
+ *   --measure SECONDS  length of the measured period (default 5)
+ *   --checkpoint       checkpoint after warm-up and measure after restore
+ */
+public class Render {
+
+    static final int WIDTH = 800;
+    static final int HEIGHT = 600;
+
+    private final BufferedImage sprite;
+    private final Font font = new Font(Font.SANS_SERIF, Font.PLAIN, 14);
+    private long frame;
+
+    Render() {
+        sprite = new BufferedImage(64, 64, BufferedImage.TYPE_INT_ARGB);
+        Graphics2D g = sprite.createGraphics();
+        g.setPaint(new GradientPaint(0, 0, Color.ORANGE, 64, 64, new Color(0, 0, 255, 128)));
+        g.fillOval(0, 0, 64, 64);
+        g.dispose();
+    }
+
+    void render(Graphics2D g) {
+        long f = frame++;
+        g.setRenderingHint(RenderingHints.KEY_ANTIALIASING, RenderingHints.VALUE_ANTIALIAS_OFF);
+        g.setColor(Color.WHITE);
+        g.fillRect(0, 0, WIDTH, HEIGHT);
+        for (int i = 0; i < 100; ++i) {
+            g.setColor(new Color((int) (f * 31 + i * 7919) & 0xffffff));
+            g.fillRect((int) ((i * 37 + f) % WIDTH), (i * 53) % HEIGHT, 40, 30);
+        }
+
+        g.setRenderingHint(RenderingHints.KEY_ANTIALIASING, RenderingHints.VALUE_ANTIALIAS_ON);
+        g.setStroke(new BasicStroke(3f, BasicStroke.CAP_ROUND, BasicStroke.JOIN_ROUND));
+        Path2D.Double path = new Path2D.Double();
+        path.moveTo(0, HEIGHT / 2.0);
+        for (int x = 0; x < WIDTH; x += 10) {
+            path.lineTo(x, HEIGHT / 2.0 + 100 * Math.sin((x + f * 5) / 50.0));
+        }
+        g.setColor(Color.BLACK);
+        g.draw(path);
+        for (int i = 0; i < 50; ++i) {
+            g.setPaint(new GradientPaint(0, 0, Color.RED, 50, 50, Color.GREEN, true));
+            g.fill(new Ellipse2D.Double((i * 97 + f * 3) % WIDTH, (i * 61) % HEIGHT, 50, 50));
+        }
+
+        g.setComposite(AlphaComposite.getInstance(AlphaComposite.SRC_OVER, 0.5f));
+        AffineTransform at = g.getTransform();
+        for (int i = 0; i < 50; ++i) {
+            g.translate((i * 71 + f * 2) % WIDTH, (i * 43) % HEIGHT);
+            g.rotate((f + i) / 20.0);
+            g.drawImage(sprite, 0, 0, 32 + i % 64, 32 + i % 64, null);
+            g.setTransform(at);
+        }
+        g.setComposite(AlphaComposite.SrcOver);
+
+        g.setRenderingHint(RenderingHints.KEY_TEXT_ANTIALIASING, RenderingHints.VALUE_TEXT_ANTIALIAS_ON);
+        g.setFont(font);
+        g.setColor(Color.DARK_GRAY);
+        for (int i = 0; i < 30; ++i) {
+            g.drawString("Frame " + f + " line " + i + " The quick brown fox", 10 + (i % 3) * 250, 20 + i * 19);
+        }
+    }
+
+    long[] run(BufferedImage target, double seconds) {
+        long[] times = new long[1024];
+        int n = 0;
+        long start = System.nanoTime();
+        long end = start + (long) (seconds * 1e9);
+        long now;
+        while ((now = System.nanoTime()) < end) {
+            Graphics2D g = target.createGraphics();
+            render(g);
+            g.dispose();
+            if (n == times.length) {
+                times = Arrays.copyOf(times, n * 2);
+            }
+            times[n++] = System.nanoTime() - start;
+        }
+        return Arrays.copyOf(times, n);
+    }
+
+    static String report(long[] ends) {
+        if (ends.length == 0) {
+            return "error=noframes";
+        }
+        long[] frames = new long[ends.length];
+        int firstSecond = 0;
+        for (int i = 0; i < ends.length; ++i) {
+            frames[i] = ends[i] - (i == 0 ? 0 : ends[i - 1]);
+            if (ends[i] <= 1_000_000_000L) {
+                ++firstSecond;
+            }
+        }
+        long first = frames[0];
+        Arrays.sort(frames);
+        return String.format("first_frame_ms=%.3f first_second_frames=%d p50_ms=%.3f p99_ms=%.3f max_ms=%.3f fps=%.1f",
+                first / 1e6, firstSecond, frames[(frames.length - 1) / 2] / 1e6,
+                frames[(int) Math.ceil(frames.length * 0.99) - 1] / 1e6, frames[frames.length - 1] / 1e6,
+                ends.length / (ends[ends.length - 1] / 1e9));
+    }
+
+    public static void main(String[] args) throws Exception {
+        Path out = null;
+        double warmup = 0;
+        double measure = 5;
+        boolean checkpoint = false;
+        for (int i = 0; i < args.length; ++i) {
+            switch (args[i]) {
+                case "--out": out = Paths.get(args[++i]); break;
+                case "--warmup": warmup = Double.parseDouble(args[++i]); break;
+                case "--measure": measure = Double.parseDouble(args[++i]); break;
+                case "--checkpoint": checkpoint = true; break;
+                default: throw new IllegalArgumentException("Unknown option " + args[i]);
+            }
+        }
+        if (out == null) {
+            throw new IllegalArgumentException("--out is required");
+        }
+
+        Render render = new Render();
+        BufferedImage t = new BufferedImage(WIDTH, HEIGHT, BufferedImage.TYPE_INT_RGB);
+        if (warmup > 0) {
+            render.run(t, warmup);
+        }
+        if (checkpoint) {
+            try {
+                Core.checkpointRestore();
+            } catch (Exception e) {
+                Files.writeString(out, "error=" + e.getClass().getSimpleName() + "\n");
+                System.exit(1);
+            }
+        }
+        Instant start = Instant.now();
+        String result = report(render.run(t, measure));
+        Files.writeString(out, result + " start_ns=" + (start.getEpochSecond() * 1_000_000_000L + start.getNano()) + "\n");
+        System.exit(0);
+    }
+}
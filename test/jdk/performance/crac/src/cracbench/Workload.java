@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+ * CA 94089 USA or visit www.azul.com if you need additional information or
+ * have any questions.
+ */
+
+package cracbench;
+
+import com.sun.net.httpserver.HttpExchange;
+import com.sun.net.httpserver.HttpServer;
+
+import java.io.IOException;
+import java.io.OutputStream;
+import java.net.InetAddress;
+import java.net.InetSocketAddress;
+import java.nio.charset.StandardCharsets;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.nio.file.StandardOpenOption;
+import java.time.Instant;
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.locks.LockSupport;
+
+import jdk.crac.Context;
+import jdk.crac.Core;
+import jdk.crac.Resource;
+
+/**
+ * A small HTTP service used as the reference application of the benchmarks.
+ *
+ * Each request does some map, string and sorting work, which is what the
+ * JIT warms up on. The listening socket is closed before checkpoint and a
+ * new one is opened after restore, on the same port if the service was
+ * listening before. The port of every new socket is written to a fresh
+ * file in the port directory, which is how the benchmark driver finds a
+ * running or restored instance.
+ *
+ * Options:
+ *   --port-dir DIR     where to announce the port (required)
+ *   --warmup N         requests to serve internally before going on
+ *   --checkpoint       checkpoint after warm-up, e.g. with -XX:CRaCCheckpointTo
+ *   --full-gc          run a full GC before the checkpoint
+ *   --heap-mb N        keep N MB of live data on the heap
+ *   --threads N        start N idle threads
+ *   --events FILE      append "checkpoint_start NS" and "checkpoint_end NS"
+ *                      lines, in CLOCK_REALTIME nanoseconds, to FILE
+ */
+public class Workload implements Resource {
+
+    // Live data for --heap-mb, referenced for the lifetime of the process
+    static final List<byte[]> retained = new ArrayList<>();
+
+    private final Path portDir;
+    private final Path events;
+    private HttpServer server;
+    private int port;
+
+    Workload(Path portDir, Path events) {
+        this.portDir = portDir;
+        this.events = events;
+    }
+
+    static byte[] work(int seed) {
+        Map<String, Integer> counts = new HashMap<>();
+        List<String> words = new ArrayList<>();
+        for (int i = 0; i < 2000; ++i) {
+            String w = Integer.toString((seed + i * 7919) % 1009, 36);
+            words.add(w);
+            counts.merge(w, 1, Integer::sum);
+        }
+        words.sort(null);
+        StringBuilder sb = new StringBuilder("{\"distinct\":").append(counts.size())
+                .append(",\"first\":\"").append(words.get(0))
+                .append("\",\"last\":\"").append(words.get(words.size() - 1)).append("\"}\n");
+        return sb.toString().getBytes(StandardCharsets.UTF_8);
+    }
+
+    private void handle(HttpExchange exchange) throws IOException {
+        byte[] body = work(exchange.getRequestURI().hashCode());
+        exchange.sendResponseHeaders(200, body.length);
+        try (OutputStream os = exchange.getResponseBody()) {
+            os.write(body);
+        }
+    }
+
+    static void retain(int mb) {
+        for (int i = 0; i < mb; ++i) {
+            byte[] chunk = new byte[1 << 20];
+            // Non-zero contents, so the pages are really there to dump
+            for (int j = 0; j < chunk.length; j += 512) {
+                chunk[j] = (byte) (i + j);
+            }
+            retained.add(chunk);
+        }
+    }
+
+    static void idleThreads(int n) {
+        for (int i = 0; i < n; ++i) {
+            Thread t = new Thread(() -> {
+                while (true) {
+                    LockSupport.park();
+                }
+            }, "idle-" + i);
+            t.setDaemon(true);
+            t.start();
+        }
+    }
+
+    synchronized void start() throws IOException {
+        try {
+            server = HttpServer.create(new InetSocketAddress(InetAddress.getLoopbackAddress(), port), 64);
+        } catch (IOException e) {
+            if (port == 0) {
+                throw e;
+            }
+            // Taken while we were checkpointed, take any
+            server = HttpServer.create(new InetSocketAddress(InetAddress.getLoopbackAddress(), 0), 64);
+        }
+        server.createContext("/", this::handle);
+        server.start();
+        port = server.getAddress().getPort();
+        Path tmp = Files.createTempFile(portDir, "port-", ".tmp");
+        Files.writeString(tmp, Integer.toString(port));
+        // Rename so that readers never see a partially written file
+        Files.move(tmp, Paths.get(tmp.toString().replaceFirst("\\.tmp$", "")));
+    }
+
+    synchronized void stop() {
+        if (server != null) {
+            server.stop(0);
+            server = null;
+        }
+    }
+
+    private void event(String name) throws IOException {
+        if (events != null) {
+            Instant now = Instant.now();
+            Files.writeString(events, name + " " + (now.getEpochSecond() * 1_000_000_000L + now.getNano()) + "\n",
+                    StandardOpenOption.CREATE, StandardOpenOption.APPEND);
+        }
+    }
+
+    @Override
+    public void beforeCheckpoint(Context<? extends Resource> context) throws Exception {
+        event("checkpoint_start");
+        stop();
+    }
+
+    @Override
+    public void afterRestore(Context<? extends Resource> context) throws Exception {
+        start();
+        event("checkpoint_end");
+    }
+
+    public static void main(String[] args) throws Exception {
+        Path portDir = null;
+        Path events = null;
+        int warmup = 0;
+        boolean checkpoint = false;
+        boolean fullGc = false;
+        int heapMb = 0;
+        int threads = 0;
+        for (int i = 0; i < args.length; ++i) {
+            switch (args[i]) {
+                case "--port-dir": portDir = Paths.get(args[++i]); break;
+                case "--warmup": warmup = Integer.parseInt(args[++i]); break;
+                case "--checkpoint": checkpoint = true; break;
+                case "--full-gc": fullGc = true; break;
+                case "--heap-mb": heapMb = Integer.parseInt(args[++i]); break;
+                case "--threads": threads = Integer.parseInt(args[++i]); break;
+                case "--events": events = Paths.get(args[++i]); break;
+                default: throw new IllegalArgumentException("Unknown option " + args[i]);
+            }
+        }
+        if (portDir == null) {
+            throw new IllegalArgumentException("--port-dir is required");
+        }
+        Files.createDirectories(portDir);
+
+        Workload workload = new Workload(portDir, events);
+        Core.getGlobalContext().register(workload);
+        retain(heapMb);
+        idleThreads(threads);
+
+        long sink = 0;
+        for (int i = 0; i < warmup; ++i) {
+            sink += work(i).length;
+        }
+        if (sink < 0) {
+            System.out.println(sink);
+        }
+
+        if (checkpoint) {
+            if (fullGc) {
+                System.gc();
+            }
+            Core.checkpointRestore();
+        } else {
+            workload.start();
+        }
+        Thread.currentThread().join();
+    }
+}
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+ * CA 94089 USA or visit www.azul.com if you need additional information or
+ * have any questions.
+ */
+
+/*
+ * Measures the overhead of criuengine itself, with fakecriu standing in
+ * for CRIU (CRAC_CRIU_PATH must point to it).
+ *
+ * The harness plays the JVM: it runs "criuengine checkpoint" as its child
+ * and waits for the restore signal, then runs "criuengine restore" and
+ * waits for it to finish. Timestamps from fakecriu's trace split each
+ * operation into steps:
+ *
+ *   checkpoint.return     engine invoked -> engine returned to the JVM
+ *   checkpoint.spawn      engine invoked -> CRIU started (fork chain,
+ *                         reparenting, argv building, exec)
+ *   checkpoint.criu       CRIU started -> CRIU done (FAKECRIU_DUMP_DELAY_MS)
+ *   checkpoint.kick       CRIU done -> JVM got the restore signal
+ *   restore.exec          engine invoked -> CRIU started
+ *   restore.criu          CRIU started -> post-resume script started
+ *   restore.post_resume   post-resume started -> JVM got the restore signal
+ *   restore.restorewait   JVM got the signal -> restorewait returned
+ *
+ * With -O, every image is rewritten by "criuengine optimize" before it is
+ * restored, and restored through the userfaultfd injector (one thread
+ * unless CRAC_RESTORE_UFFD_THREADS says otherwise), so that fakecriu
+ * checks the memory of the fake JVM against what it dumped.
+ *
+ * Usage: enginebench -e ENGINE -d WORKDIR [-n ITERATIONS] [-O]
+ * Prints CSV: step,n,mean_us,min_us,p50_us,p99_us,max_us
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define RESTORE_SIGNAL   (SIGRTMIN + 2)
+
+enum {
+    CKPT_RETURN, CKPT_SPAWN, CKPT_CRIU, CKPT_KICK,
+    REST_EXEC, REST_CRIU, REST_POST_RESUME, REST_RESTOREWAIT,
+    NSTEPS
+};
+
+static const char *step_names[NSTEPS] = {
+    "checkpoint.return", "checkpoint.spawn", "checkpoint.criu", "checkpoint.kick",
+    "restore.exec", "restore.criu", "restore.post_resume", "restore.restorewait",
+};
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long long trace_event(const char *trace, const char *event) {
+    FILE *f = fopen(trace, "r");
+    if (!f) {
+        return -1;
+    }
+    char name[64];
+    long long ns, found = -1;
+    while (fscanf(f, "%63s %lld", name, &ns) == 2) {
+        if (!strcmp(name, event)) {
+            found = ns;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+static pid_t run(const char *engine, const char *action, const char *dir) {
+    pid_t pid = fork();
+    if (!pid) {
+        execl(engine, engine, action, dir, (char *)NULL);
+        perror(engine);
+        _exit(127);
+    }
+    return pid;
+}
+
+static int cmp(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[]) {
+    const char *engine = NULL, *workdir = NULL;
+    int iterations = 100;
+    int optimize = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "e:d:n:O")) != -1) {
+        switch (opt) {
+            case 'e': engine = optarg; break;
+            case 'd': workdir = optarg; break;
+            case 'n': iterations = atoi(optarg); break;
+            case 'O': optimize = 1; break;
+            default: engine = NULL; break;
+        }
+    }
+    if (!engine || !workdir || iterations <= 0) {
+        fprintf(stderr, "usage: enginebench -e ENGINE -d WORKDIR [-n ITERATIONS] [-O]\n");
+        return 1;
+    }
+    if (optimize) {
+        setenv("CRAC_RESTORE_UFFD_THREADS", "1", 0);
+    }
+    if (!getenv("CRAC_CRIU_PATH")) {
+        fprintf(stderr, "enginebench: CRAC_CRIU_PATH must point to fakecriu\n");
+        return 1;
+    }
+
+    char trace[4096], imagedir[4096];
+    snprintf(trace, sizeof(trace), "%s/trace", workdir);
+    snprintf(imagedir, sizeof(imagedir), "%s/image", workdir);
+    if ((mkdir(workdir, 0755) && errno != EEXIST) || (mkdir(imagedir, 0755) && errno != EEXIST)) {
+        perror(imagedir);
+        return 1;
+    }
+    setenv("FAKECRIU_TRACE", trace, 1);
+    // The harness has to survive the checkpoint, as a JVM would with it
+    setenv("CRAC_CRIU_LEAVE_RUNNING", "1", 1);
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, RESTORE_SIGNAL);
+    sigprocmask(SIG_BLOCK, &set, NULL);
+
+    long long *samples[NSTEPS];
+    for (int s = 0; s < NSTEPS; ++s) {
+        samples[s] = calloc(iterations, sizeof(long long));
+    }
+
+    int n = 0;
+    for (int i = 0; i < iterations; ++i) {
+        int status;
+        unlink(trace);
+
+        long long start = now_ns();
+        pid_t pid = run(engine, "checkpoint", imagedir);
+        waitpid(pid, &status, 0);
+        long long returned = now_ns();
+        struct timespec timeout = { 30, 0 };
+        siginfo_t info;
+        if (sigtimedwait(&set, &info, &timeout) < 0 || info.si_value.sival_int != 0) {
+            fprintf(stderr, "enginebench: checkpoint #%d failed\n", i);
+            continue;
+        }
+        long long kicked = now_ns();
+        long long dump_start = trace_event(trace, "criu_dump_start");
+        long long dump_end = trace_event(trace, "criu_dump_end");
+        if (optimize) {
+            pid = run(engine, "optimize", imagedir);
+            if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status)) {
+                fprintf(stderr, "enginebench: optimize #%d failed\n", i);
+                continue;
+            }
+        }
+
+        unlink(trace);
+        long long restore_start = now_ns();
+        pid = run(engine, "restore", imagedir);
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status)) {
+            fprintf(stderr, "enginebench: restore #%d failed\n", i);
+            continue;
+        }
+        long long restore_end = now_ns();
+        long long criu_start = trace_event(trace, "criu_restore_start");
+        long long post_resume = trace_event(trace, "criu_post_resume");
+        long long jvm_kicked = trace_event(trace, "jvm_kicked");
+        if (dump_start < 0 || dump_end < 0 || criu_start < 0 || post_resume < 0 || jvm_kicked < 0) {
+            fprintf(stderr, "enginebench: incomplete trace in iteration #%d\n", i);
+            continue;
+        }
+
+        samples[CKPT_RETURN][n] = returned - start;
+        samples[CKPT_SPAWN][n] = dump_start - start;
+        samples[CKPT_CRIU][n] = dump_end - dump_start;
+        samples[CKPT_KICK][n] = kicked - dump_end;
+        samples[REST_EXEC][n] = criu_start - restore_start;
+        samples[REST_CRIU][n] = post_resume - criu_start;
+        samples[REST_POST_RESUME][n] = jvm_kicked - post_resume;
+        samples[REST_RESTOREWAIT][n] = restore_end - jvm_kicked;
+        ++n;
+    }
+
+    printf("step,n,mean_us,min_us,p50_us,p99_us,max_us\n");
+    for (int s = 0; s < NSTEPS && n; ++s) {
+        qsort(samples[s], n, sizeof(long long), cmp);
+        long long sum = 0;
+        for (int i = 0; i < n; ++i) {
+            sum += samples[s][i];
+        }
+        printf("%s,%d,%.1f,%.1f,%.1f,%.1f,%.1f\n", step_names[s], n, sum / 1e3 / n,
+                samples[s][0] / 1e3, samples[s][n / 2] / 1e3,
+                samples[s][(n * 99 + 99) / 100 - 1] / 1e3, samples[s][n - 1] / 1e3);
+    }
+    return n == iterations ? 0 : 1;
+}
@@ -0,0 +1,447 @@
+/*
+ * Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+ * CA 94089 USA or visit www.azul.com if you need additional information or
+ * have any questions.
+ */
+
+/*
+ * A stand-in for CRIU to exercise criuengine without privileges.
+ *
+ * "dump" writes a fake image into the -D directory, and kills the target
+ * unless -R is given. The image has an mm-1.img with one anonymous private
+ * VMA at FAKE_VADDR, a pagemap-1.img describing pages-1.img as lazy pages
+ * in it, with every HOLE_EVERY-th page left out as never populated, and a
+ * pstree.img with the pid of the target.
+ * "restore" forks a fake JVM that waits for the restore signal, runs the
+ * --action-script for post-resume and replaces itself with the --exec-cmd,
+ * the way CRIU does. With --lazy-pages the fake JVM maps FAKE_VADDR,
+ * registers it with userfaultfd and sends that to lazy-pages.socket, which
+ * it leaves open, then drops the last sixteenth of it with MADV_DONTNEED,
+ * which must read as zeroes from then on; once kicked, it checks the memory
+ * against the image and exits with 2 on a mismatch.
+ *
+ * Environment:
+ *   FAKECRIU_DUMP_DELAY_MS, FAKECRIU_RESTORE_DELAY_MS   time to spend working
+ *   FAKECRIU_DUMP_EXIT, FAKECRIU_RESTORE_EXIT           exit codes to simulate
+ *   FAKECRIU_IMAGE_KB                                   size of the memory
+ *   FAKECRIU_TRACE     file to append "EVENT CLOCK_MONOTONIC-ns" lines to
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <linux/userfaultfd.h>
+
+#define RESTORE_SIGNAL   (SIGRTMIN + 2)
+
+#define FAKE_VADDR 0x7e0000000000ULL
+#define HOLE_EVERY 8
+
+static int env_int(const char *name, int def) {
+    const char *value = getenv(name);
+    return value ? atoi(value) : def;
+}
+
+static void trace(const char *event) {
+    const char *path = getenv("FAKECRIU_TRACE");
+    if (!path) {
+        return;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    char buf[128];
+    int len = snprintf(buf, sizeof(buf), "%s %lld\n", event, ts.tv_sec * 1000000000LL + ts.tv_nsec);
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd >= 0) {
+        if (write(fd, buf, len) != len) {
+            perror("fakecriu: trace");
+        }
+        close(fd);
+    }
+}
+
+static void delay(const char *name) {
+    int ms = env_int(name, 0);
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) && errno == EINTR);
+}
+
+static int write_file(const char *dir, const char *name, long kb) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    static char block[1024];
+    for (long i = 0; i < kb; ++i) {
+        block[0] = (char)i;
+        fwrite(block, sizeof(block), 1, f);
+    }
+    return fclose(f) ? 1 : 0;
+}
+
+static unsigned char *put_varint(unsigned char *p, uint64_t v) {
+    for (; v > 0x7f; v >>= 7) {
+        *p++ = (v & 0x7f) | 0x80;
+    }
+    *p++ = v;
+    return p;
+}
+
+// One "u32 length, message" record of varint fields 1, 2, ...
+static size_t put_record(unsigned char *buf, const uint64_t *values, int n) {
+    unsigned char *p = buf + sizeof(uint32_t);
+    for (int i = 0; i < n; ++i) {
+        p = put_varint(p, (uint64_t)(i + 1) << 3);
+        p = put_varint(p, values[i]);
+    }
+    uint32_t len = p - buf - sizeof(uint32_t);
+    memcpy(buf, &len, sizeof(len));
+    return p - buf;
+}
+
+static int write_image(const char *dir, const char *name, const unsigned char *buf, size_t len) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "w");
+    if (!f || fwrite(buf, len, 1, f) != 1) {
+        perror(path);
+        if (f) {
+            fclose(f);
+        }
+        return 1;
+    }
+    return fclose(f) ? 1 : 0;
+}
+
+static int is_hole(size_t page) {
+    return page % HOLE_EVERY == HOLE_EVERY - 1;
+}
+
+// The content of the memory at off: the number of the KiB in its first
+// byte, zeroes in holes
+static void fill_block(char *block, size_t off, size_t page) {
+    memset(block, 0, 1024);
+    block[0] = is_hole(off / page) ? 0 : (char)(off / 1024);
+}
+
+// The present pages of the memory, in address order
+static int write_pages(const char *dir, long kb) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/pages-1.img", dir);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    size_t page = sysconf(_SC_PAGESIZE);
+    static char block[1024];
+    for (size_t off = 0; off < (size_t)kb * 1024; off += sizeof(block)) {
+        if (!is_hole(off / page)) {
+            fill_block(block, off, page);
+            fwrite(block, sizeof(block), 1, f);
+        }
+    }
+    return fclose(f) ? 1 : 0;
+}
+
+// PagemapHead { pages_id = 1 } and a PagemapEntry per run of present pages,
+// flagged PE_LAZY | PE_PRESENT
+static int write_pagemap(const char *dir, long kb) {
+    size_t pages = kb * 1024 / sysconf(_SC_PAGESIZE);
+    unsigned char *buf = malloc(64 + (pages / HOLE_EVERY + 1) * 64);
+    if (!buf) {
+        perror("fakecriu: malloc");
+        return 1;
+    }
+    uint32_t magic[2] = { 0x54564319, 0x56084025 };
+    memcpy(buf, magic, sizeof(magic));
+    size_t len = sizeof(magic);
+    uint64_t head[] = { 1 };
+    len += put_record(buf + len, head, 1);
+    for (size_t p = 0; p < pages; p += HOLE_EVERY) {
+        size_t n = pages - p < HOLE_EVERY - 1 ? pages - p : HOLE_EVERY - 1;
+        uint64_t entry[] = { FAKE_VADDR + p * sysconf(_SC_PAGESIZE), n, 0, (1 << 1) | (1 << 2) };
+        len += put_record(buf + len, entry, 4);
+    }
+    int ret = write_image(dir, "pagemap-1.img", buf, len);
+    free(buf);
+    return ret;
+}
+
+// MmEntry with one VmaEntry { start, end, status = VMA_AREA_REGULAR |
+// VMA_ANON_PRIVATE } for the memory
+static int write_mm(const char *dir, long kb) {
+    unsigned char buf[128], vma[64];
+    uint32_t magic[2] = { 0x54564319, 0x57492820 };
+    memcpy(buf, magic, sizeof(magic));
+    unsigned char *p = vma;
+    p = put_varint(p, 1 << 3);
+    p = put_varint(p, FAKE_VADDR);
+    p = put_varint(p, 2 << 3);
+    p = put_varint(p, FAKE_VADDR + kb * 1024);
+    p = put_varint(p, 7 << 3);
+    p = put_varint(p, (1 << 0) | (1 << 9));
+    unsigned char *m = buf + sizeof(magic) + sizeof(uint32_t);
+    m = put_varint(m, 14 << 3 | 2); // MmEntry.vmas, length-delimited
+    m = put_varint(m, p - vma);
+    memcpy(m, vma, p - vma);
+    m += p - vma;
+    uint32_t len = m - buf - sizeof(magic) - sizeof(uint32_t);
+    memcpy(buf + sizeof(magic), &len, sizeof(len));
+    return write_image(dir, "mm-1.img", buf, m - buf);
+}
+
+// A single-threaded process with the pid of the target
+static int write_pstree(const char *dir, pid_t pid) {
+    unsigned char buf[64];
+    uint32_t magic[2] = { 0x54564319, 0x50273030 };
+    memcpy(buf, magic, sizeof(magic));
+    uint64_t entry[] = { pid, 0, pid, pid, pid };
+    size_t len = sizeof(magic) + put_record(buf + sizeof(magic), entry, 5);
+    return write_image(dir, "pstree.img", buf, len);
+}
+
+static int dump(pid_t pid, const char *dir, int leave_running) {
+    trace("criu_dump_start");
+    delay("FAKECRIU_DUMP_DELAY_MS");
+    int code = env_int("FAKECRIU_DUMP_EXIT", 0);
+    if (!code && dir) {
+        long kb = env_int("FAKECRIU_IMAGE_KB", 1024);
+        code = write_file(dir, "inventory.img", 1) || write_pages(dir, kb) || write_pagemap(dir, kb) || write_mm(dir, kb)
+            || (pid > 0 && write_pstree(dir, pid));
+    }
+    if (!code && !leave_running && pid > 0) {
+        kill(pid, SIGKILL);
+    }
+    trace("criu_dump_end");
+    return code;
+}
+
+// In the fake JVM: registers the memory of the image with userfaultfd and
+// sends the descriptor to the lazy pages daemon the way CRIU does
+static int send_uffd(size_t len) {
+    void *mem = mmap((void *)FAKE_VADDR, len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    int uffd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+    struct uffdio_api api = { .api = UFFD_API, .features = UFFD_FEATURE_EVENT_REMOVE };
+    struct uffdio_register reg = { .range = { FAKE_VADDR, len }, .mode = UFFDIO_REGISTER_MODE_MISSING };
+    if (mem == MAP_FAILED || uffd < 0 || ioctl(uffd, UFFDIO_API, &api) || ioctl(uffd, UFFDIO_REGISTER, &reg)) {
+        perror("fakecriu: userfaultfd");
+        return 1;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX, .sun_path = "lazy-pages.socket" };
+    int sk = socket(AF_UNIX, SOCK_STREAM, 0);
+    int pid = 1;
+    char dummy = 0;
+    struct iovec iov = { &dummy, 1 };
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf) };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &uffd, sizeof(uffd));
+    if (sk < 0 || connect(sk, (struct sockaddr *)&addr, sizeof(addr))
+            || send(sk, &pid, sizeof(pid), 0) != sizeof(pid) || sendmsg(sk, &msg, 0) != 1) {
+        perror("fakecriu: lazy-pages.socket");
+        return 1;
+    }
+    // The socket stays open until the fake JVM exits, after post-resume:
+    // the daemon has to stop after the processes of pstree.img
+    close(uffd);
+    return 0;
+}
+
+// In the fake JVM: gives the end of the memory back while the pages are
+// being injected, as the JVM may do right after restore, and reads it so
+// that its faults reach the injector. Returns where the dropped part starts.
+static size_t drop_tail(size_t len) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t from = len - len / 16 / page * page;
+    if (from < len && madvise((char *)FAKE_VADDR + from, len - from, MADV_DONTNEED)) {
+        perror("fakecriu: madvise");
+        return len;
+    }
+    for (size_t off = from; off < len; off += page) {
+        (void)*(volatile char *)(FAKE_VADDR + off);
+    }
+    return from;
+}
+
+// In the fake JVM: compares the memory with what dump wrote to pages-1.img,
+// and with zeroes from dropped on. Like CRIU, it does not read the lazy
+// pages of the image, which the engine may leave out of the images it
+// hands to CRIU.
+static int check_memory(size_t len, size_t dropped) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    static char block[1024];
+    for (size_t off = 0; off < len; off += sizeof(block)) {
+        fill_block(block, off, page);
+        block[0] = off < dropped ? block[0] : 0;
+        if (memcmp(block, (char *)FAKE_VADDR + off, sizeof(block))) {
+            fprintf(stderr, "fakecriu: memory differs from the image at offset %zu\n", off);
+            return 2;
+        }
+    }
+    return 0;
+}
+
+static int restore(const char *dir, const char *script, char **exec_cmd, int lazy) {
+    trace("criu_restore_start");
+    delay("FAKECRIU_RESTORE_DELAY_MS");
+    int code = env_int("FAKECRIU_RESTORE_EXIT", 0);
+    if (code) {
+        return code;
+    }
+
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, RESTORE_SIGNAL);
+    sigprocmask(SIG_BLOCK, &set, &old);
+    size_t len = (size_t)env_int("FAKECRIU_IMAGE_KB", 1024) * 1024;
+    int ready[2];
+    if (pipe(ready)) {
+        perror("fakecriu: pipe");
+        return 1;
+    }
+    pid_t jvm = fork();
+    if (jvm < 0) {
+        perror("fakecriu: fork");
+        return 1;
+    }
+    if (!jvm) {
+        close(ready[0]);
+        char sent = lazy && dir ? !send_uffd(len) : 1;
+        if (write(ready[1], &sent, 1) != 1 || !sent) {
+            exit(1);
+        }
+        size_t dropped = lazy && dir ? drop_tail(len) : len;
+        close(ready[1]);
+        siginfo_t info;
+        while (sigwaitinfo(&set, &info) < 0 && errno == EINTR);
+        trace("jvm_kicked");
+        if (info.si_value.sival_int != 0) {
+            exit(1);
+        }
+        exit(lazy && dir ? check_memory(len, dropped) : 0);
+    }
+    sigprocmask(SIG_SETMASK, &old, NULL);
+
+    // CRIU finishes restoring every process before post-resume
+    close(ready[1]);
+    char sent = 0;
+    if (read(ready[0], &sent, 1) != 1 || !sent) {
+        fprintf(stderr, "fakecriu: lazy restore failed\n");
+        kill(jvm, SIGKILL);
+        return 1;
+    }
+    close(ready[0]);
+
+    char pidstr[32];
+    snprintf(pidstr, sizeof(pidstr), "%d", jvm);
+    setenv("CRTOOLS_INIT_PID", pidstr, 1);
+
+    if (script) {
+        trace("criu_post_resume");
+        pid_t child = fork();
+        if (!child) {
+            setenv("CRTOOLS_SCRIPT_ACTION", "post-resume", 1);
+            execl(script, script, (char *)NULL);
+            perror("fakecriu: action script");
+            exit(1);
+        }
+        int status;
+        if (waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status)) {
+            fprintf(stderr, "fakecriu: post-resume script failed\n");
+            kill(jvm, SIGKILL);
+            return 1;
+        }
+    }
+
+    if (exec_cmd && exec_cmd[0]) {
+        trace("criu_exec_cmd");
+        execv(exec_cmd[0], exec_cmd);
+        perror("fakecriu: exec-cmd");
+        return 1;
+    }
+    int status;
+    waitpid(jvm, &status, 0);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: fakecriu dump|restore OPTIONS...\n");
+        return 1;
+    }
+    pid_t pid = -1;
+    const char *dir = NULL;
+    const char *script = NULL;
+    char **exec_cmd = NULL;
+    int leave_running = 0;
+    int lazy = 0;
+    for (int i = 2; i < argc; ++i) {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            pid = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-D") && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (!strcmp(argv[i], "--action-script") && i + 1 < argc) {
+            script = argv[++i];
+        } else if (!strcmp(argv[i], "-R")) {
+            leave_running = 1;
+        } else if (!strcmp(argv[i], "--lazy-pages")) {
+            lazy = 1;
+        } else if (!strcmp(argv[i], "--exec-cmd")) {
+            if (i + 1 < argc && !strcmp(argv[i + 1], "--")) {
+                ++i;
+            }
+            exec_cmd = argv + i + 1;
+            break;
+        }
+    }
+
+    if (!strcmp(argv[1], "dump")) {
+        return dump(pid, dir, leave_running);
+    } else if (!strcmp(argv[1], "restore")) {
+        return restore(dir, script, exec_cmd, lazy);
+    }
+    fprintf(stderr, "fakecriu: unsupported action %s\n", argv[1]);
+    return 1;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2026, Azul Systems, Inc. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Azul Systems, 385 Moffett Park Drive, Suite 115, Sunnyvale,
+ * CA 94089 USA or visit www.azul.com if you need additional information or
+ * have any questions.
+ */
+
+/*
+ * Image statistics that CRIU's own tools do not report.
+ *
+ *   imgstat zero IMAGEDIR
+ *       Prints "image_bytes=B page_bytes=P pages=N zero_pages=Z" for the
+ *       image: the size of all files, the size of the page dumps and how
+ *       many of the dumped pages are all zeros, i.e. could have been left
+ *       out of the image.
+ *
+ *   imgstat evict IMAGEDIR
+ *       Writes back and drops the image files from the page cache, so the
+ *       next restore reads them from the storage.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define PAGE 4096
+
+static int zero(const char *imagedir) {
+    DIR *dir = opendir(imagedir);
+    if (!dir) {
+        perror(imagedir);
+        return 1;
+    }
+    static char buf[256 * PAGE];
+    long long image_bytes = 0, page_bytes = 0, pages = 0, zero_pages = 0;
+    struct dirent *de;
+    while ((de = readdir(dir))) {
+        char path[4096];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", imagedir, de->d_name);
+        if (stat(path, &st) || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        image_bytes += st.st_size;
+        if (strncmp(de->d_name, "pages-", 6)) {
+            continue;
+        }
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            perror(path);
+            closedir(dir);
+            return 1;
+        }
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            page_bytes += n;
+            for (ssize_t off = 0; off < n; off += PAGE) {
+                size_t len = n - off < PAGE ? n - off : PAGE;
+                ++pages;
+                // A page is zero if its first byte is and it equals itself shifted by one
+                if (!buf[off] && !memcmp(buf + off, buf + off + 1, len - 1)) {
+                    ++zero_pages;
+                }
+            }
+        }
+        close(fd);
+        if (n < 0) {
+            perror(path);
+            closedir(dir);
+            return 1;
+        }
+    }
+    closedir(dir);
+    printf("image_bytes=%lld page_bytes=%lld pages=%lld zero_pages=%lld\n",
+           image_bytes, page_bytes, pages, zero_pages);
+    return 0;
+}
+
+static int evict(const char *imagedir) {
+    DIR *dir = opendir(imagedir);
+    if (!dir) {
+        perror(imagedir);
+        return 1;
+    }
+    int ret = 0;
+    struct dirent *de;
+    while ((de = readdir(dir))) {
+        char path[4096];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", imagedir, de->d_name);
+        if (stat(path, &st) || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            perror(path);
+            ret = 1;
+            continue;
+        }
+        // Dirty pages are not dropped, write them back first
+        int err = fdatasync(fd) ? errno : posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        if (err) {
+            fprintf(stderr, "%s: %s\n", path, strerror(err));
+            ret = 1;
+        }
+        close(fd);
+    }
+    closedir(dir);
+    return ret;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 3 && !strcmp(argv[1], "zero")) {
+        return zero(argv[2]);
+    } else if (argc == 3 && !strcmp(argv[1], "evict")) {
+        return evict(argv[2]);
+    }
+    fprintf(stderr, "Usage: imgstat zero|evict IMAGEDIR\n");
+    return 1;
+}